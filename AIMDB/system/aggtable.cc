@@ -0,0 +1,78 @@
+/**
+ * @file    aggtable.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  hash table of groups for aggregation, keys are compared exactly and
+ *  aggregate states are stored inline in each entry.
+ *
+ */
+
+#include "aggtable.h"
+
+void AggTable::init(int64_t entry_size, const std::vector<AggKey> &keys, int64_t estimated_groups) {
+    at_entry_size = entry_size;
+    at_keys = keys;
+    at_num = 0;
+    int64_t slots = 16;
+    while (slots < estimated_groups * 2)
+        slots <<= 1;
+    at_slots.assign(slots, -1);
+    at_hashes.clear();
+    at_blocks.clear();
+}
+
+bool AggTable::keyEqual(const char *entry, const char *row) {
+    for (size_t ii = 0; ii < at_keys.size(); ii++) {
+        const AggKey &key = at_keys[ii];
+        bool equal = key.ops.compare != NULL
+            ? key.ops.compare(entry + key.offset, row + key.offset, key.ops.size) == 0
+            : memcmp(entry + key.offset, row + key.offset, key.ops.size) == 0;
+        if (!equal)
+            return false;
+    }
+    return true;
+}
+
+char *AggTable::findOrInsert(uint64_t hash, const char *row, bool &inserted) {
+    int64_t mask = at_slots.size() - 1;
+    int64_t pos = hash & mask;
+    while (at_slots[pos] >= 0) {
+        int64_t rank = at_slots[pos];
+        if (at_hashes[rank] == hash && keyEqual(getEntry(rank), row)) {
+            inserted = false;
+            return getEntry(rank);
+        }
+        pos = (pos + 1) & mask;
+    }
+    at_slots[pos] = at_num;
+    at_hashes.push_back(hash);
+    if ((at_num >> AGG_BLOCK_SHIFT) == (int64_t) at_blocks.size())
+        at_blocks.push_back(std::vector<char>(at_entry_size << AGG_BLOCK_SHIFT));
+    inserted = true;
+    char *entry = getEntry(at_num++);
+    // keep load factor at most 1/2
+    if (at_num * 2 > (int64_t) at_slots.size())
+        grow();
+    return entry;
+}
+
+void AggTable::grow(void) {
+    at_slots.assign(at_slots.size() * 2, -1);
+    int64_t mask = at_slots.size() - 1;
+    for (int64_t rank = 0; rank < at_num; rank++) {
+        int64_t pos = at_hashes[rank] & mask;
+        while (at_slots[pos] >= 0)
+            pos = (pos + 1) & mask;
+        at_slots[pos] = rank;
+    }
+}
+
+void AggTable::clear(void) {
+    at_num = 0;
+    std::vector<std::vector<char> >().swap(at_blocks);
+    std::vector<uint64_t>().swap(at_hashes);
+    std::vector<int64_t>().swap(at_slots);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file    aggtable.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  hash table of groups for aggregation, keys are compared exactly and
+ *  aggregate states are stored inline in each entry.
+ *
+ *  @basic usage:
+ *
+ *  (1) init with the entry size and the key columns of a group row.
+ *  (2) findOrInsert returns the entry of a row's group, a new entry is left
+ *      for the caller to fill, usually with the row itself as initial state.
+ *  (3) the table grows without bound, entries are kept in insertion order
+ *      and read back by rank with getEntry, they are never moved.
+ *  (4) a table is used by one thread, parallel aggregation gives each thread
+ *      its own table and merges entries of the same hash partition later.
+ *
+ */
+
+#ifndef _AGGTABLE_H
+#define _AGGTABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include "typeops.h"
+
+#define AGG_BLOCK_SHIFT (8)     /**< entries are allocated in blocks of 1<<AGG_BLOCK_SHIFT */
+
+/** definition of AggKey, a group column of an entry. */
+struct AggKey {
+    int64_t offset;     /**< offset of the column in entry and row */
+    TypeOps ops;        /**< typed compare, memcmp if none         */
+};
+
+/** definition of class AggTable. */
+class AggTable {
+  private:
+    int64_t at_entry_size = 0;          /**< size of an entry                           */
+    std::vector<AggKey> at_keys;        /**< group columns                              */
+    std::vector<std::vector<char> > at_blocks; /**< blocks of entries, insertion order, never moved */
+    std::vector<uint64_t> at_hashes;    /**< hash of each entry                         */
+    std::vector<int64_t> at_slots;      /**< open addressing slots, entry rank or -1    */
+    int64_t at_num = 0;                 /**< number of entries                          */
+  public:
+    /**
+     * init, drop entries of a previous use.
+     * @param entry_size       size of an entry, the group row is at its front
+     * @param keys             group columns
+     * @param estimated_groups expected number of groups, the table grows beyond it
+     */
+    void init(int64_t entry_size, const std::vector<AggKey> &keys, int64_t estimated_groups);
+    /**
+     * find the entry of the group of a row, insert it if new.
+     * @param hash     hash of the group columns of row
+     * @param row      row laid out as an entry, only group columns are read
+     * @param inserted set to true if the entry is new, its content is undefined
+     * @retval entry, its address does not change
+     */
+    char *findOrInsert(uint64_t hash, const char *row, bool &inserted);
+    /**
+     * get number of groups.
+     */
+    int64_t getGroupNum(void) {
+        return at_num;
+    }
+    /**
+     * get an entry by rank, in insertion order.
+     * @param rank 0 <= rank < getGroupNum()
+     * @retval entry
+     */
+    char *getEntry(int64_t rank) {
+        return at_blocks[rank >> AGG_BLOCK_SHIFT].data() + (rank & ((1L << AGG_BLOCK_SHIFT) - 1)) * at_entry_size;
+    }
+    /**
+     * get the hash of an entry by rank.
+     * @param rank 0 <= rank < getGroupNum()
+     * @retval hash given to findOrInsert
+     */
+    uint64_t getHash(int64_t rank) {
+        return at_hashes[rank];
+    }
+    /**
+     * release memory of entries.
+     */
+    void clear(void);
+  private:
+    /**
+     * whether a row has the group columns of an entry.
+     */
+    bool keyEqual(const char *entry, const char *row);
+    /**
+     * double slots and place entries again.
+     */
+    void grow(void);
+};  // class AggTable
+
+#endif
@@ -208,7 +208,7 @@ bool Catalog::initIndex(int64_t i_id)
         {
             HashIndex *p = (HashIndex *) index;
             p->init();
-            p->setCellCap(12);  // this value can be set global, it's hashtable size 1<<12 cells
+            p->setCellCap(12);  // initial hashtable size 1<<12 cells, it grows as records are inserted
             Key & key = p->getIKey();
             std::vector < int64_t > &vv = key.getKey();
             for (unsigned int ii = 0; ii < vv.size(); ii++) {
@@ -238,6 +238,86 @@ bool Catalog::initIndex(int64_t i_id)
     return true;
 }
 
+bool Catalog::analyzeTable(int64_t t_id)
+{
+    Table *table = (Table *) getObjById(t_id);
+    if (table == NULL || table->getOtype() != TABLE || table->getTtype() != ROWTABLE) {
+        printf("[Catalog][ERROR][analyzeTable]: table type error! -20\n");
+        return false;
+    }
+    std::vector < ColumnStats > stats;
+    if (::analyzeTable((RowTable *) table, stats) == false)
+        return false;
+    std::vector < int64_t > &columns = table->getColumns();
+    for (unsigned int ii = 0; ii < columns.size(); ii++) {
+        cl_stats[columns[ii]] = stats[ii];
+    }
+    cl_table_changes[t_id] = ((RowTable *) table)->getChangeNum();
+    // blocks changed since packing are packed again with the statistics
+    ((RowTable *) table)->repack();
+    return true;
+}
+
+bool Catalog::encodeTable(int64_t t_id, std::vector < std::vector < std::string > > &values)
+{
+    Table *table = (Table *) getObjById(t_id);
+    if (table == NULL || table->getOtype() != TABLE || table->getTtype() != ROWTABLE) {
+        printf("[Catalog][ERROR][encodeTable]: table type error! -22\n");
+        return false;
+    }
+    RowTable *rt = (RowTable *) table;
+    if (rt->getRecordNum() != 0) {
+        printf("[Catalog][ERROR][encodeTable]: table not empty! -23\n");
+        return false;
+    }
+    std::vector < int64_t > &columns = table->getColumns();
+    bool changed = false;
+    for (unsigned int ii = 0; ii < columns.size() && ii < values.size(); ii++) {
+        if (values[ii].empty())
+            continue;
+        Column *column = (Column *) getObjById(columns[ii]);
+        changed = column->setDictionary(values[ii]) || changed;
+    }
+    if (!changed)
+        return true;
+    // lay rows out again with the narrower column types, keep the validation column type
+    RPattern & pattern = rt->getRPattern();
+    MStorage & storage = rt->getMStorage();
+    BasicType *valid_type = pattern.getColumnType(columns.size());
+    pattern.shut();
+    storage.shut();
+    pattern.init(columns.size() + 1);
+    for (unsigned int ii = 0; ii < columns.size(); ii++)
+        pattern.addColumn(((Column *) getObjById(columns[ii]))->getDataType());
+    pattern.addColumn(valid_type);
+    storage.init(pattern.getRowSize());
+    return true;
+}
+
+bool Catalog::refreshTable(int64_t t_id)
+{
+    auto it = cl_table_changes.find(t_id);
+    if (it == cl_table_changes.end())
+        return true;
+    RowTable *table = (RowTable *) getObjById(t_id);
+    int64_t changed = table->getChangeNum() - it->second;
+    if (changed == 0 || changed < STATS_STALE_RATIO * table->getRecordNum())
+        return true;
+    return analyzeTable(t_id);
+}
+
+int64_t Catalog::getStatsVersion(int64_t t_id)
+{
+    auto it = cl_table_changes.find(t_id);
+    return it == cl_table_changes.end() ? -1 : it->second;
+}
+
+ColumnStats *Catalog::getColumnStats(int64_t c_id)
+{
+    auto st = cl_stats.find(c_id);
+    return st == cl_stats.end() ? NULL : &st->second;
+}
+
 bool Catalog::shut(void)
 {
     for (unsigned int ii = 0;ii < cl_id_obj.size(); ii++) {
@@ -24,16 +24,20 @@
 #define _CATALOG_H
 
 #include <vector>
+#include <string>
 #include <unordered_map>
 #include "schema.h"
 #include "rowtable.h"
 #include "hashindex.h"
+#include "statistics.h"
 
 /** definition of class Catalog. */
 class Catalog {
   private:
     std::vector <Object *> cl_id_obj;   /**< container of Objects  */
     std::unordered_map <std::string, Object *> cl_name_obj;    /**< name map of Objects ,name should not be the same in the whole Catalog */
+    std::unordered_map <int64_t, ColumnStats> cl_stats;         /**< statistics of columns, by column identifier */
+    std::unordered_map <int64_t, int64_t> cl_table_changes;     /**< changes of each analyzed table when it was analyzed */
 
   public:
     /**
@@ -111,6 +115,43 @@ class Catalog {
      * @retval == NULL unavaliable, deleted or not exist
      */
     Object *getObjByName(char *o_name);
+    /**
+     * dictionary encode CHARN columns of an empty row table, its rows are laid out again
+     * @param  t_id   which table to encode
+     * @param  values distinct values of each column in rank order, empty for a column to keep as CHARN
+     * @retval true   success
+     * @retval false  failure
+     */
+    bool encodeTable(int64_t t_id, std::vector < std::vector < std::string > > &values);
+    /**
+     * analyze a row table, compute statistics of all its columns (ANALYZE)
+     * @param  t_id  which table to analyze
+     * @retval true  success
+     * @retval false failure
+     */
+    bool analyzeTable(int64_t t_id);
+    /**
+     * analyze a row table again if STATS_STALE_RATIO of its records changed since its last analyze,
+     * call it before planning, estimates only read statistics
+     * @param  t_id  which table to check
+     * @retval true  success
+     * @retval false failure
+     */
+    bool refreshTable(int64_t t_id);
+    /**
+     * get the version of statistics of a table, it changes whenever they are renewed with other records
+     * @param  t_id  table identifier
+     * @retval >=0   changes of the table when it was last analyzed
+     * @retval -1    the table was never analyzed
+     */
+    int64_t getStatsVersion(int64_t t_id);
+    /**
+     * get statistics of a column
+     * @param  c_id  column identifier
+     * @retval != NULL available
+     * @retval == NULL the table of the column was never analyzed
+     */
+    ColumnStats *getColumnStats(int64_t c_id);
     /**
      * print the catalog 
      */
@@ -0,0 +1,234 @@
+/**
+ * @file    codegen.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  compile a scan pipeline (validation check, filters, projection) into a native function.
+ *
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include "codegen.h"
+
+/** compiled functions by shape key, NULL for shapes that failed to compile */
+static std::unordered_map<std::string, PipelineFunc> pipeline_cache;
+/** guards pipeline_cache, Executors may scan in several threads */
+static std::mutex pipeline_cache_mutex;
+/** whether a failed compile was reported, later failures are not */
+static bool failure_reported = false;
+
+std::string PipelineShape::key(void) const {
+    std::ostringstream os;
+    os << "r" << record_size;
+    for (size_t ii = 0; ii < filters.size(); ii++)
+        os << ":f" << filters[ii].offset << "," << filters[ii].type << "," << filters[ii].size << "," << filters[ii].compare;
+    for (size_t ii = 0; ii < outputs.size(); ii++)
+        os << ":o" << outputs[ii].offset << "," << outputs[ii].size;
+    return os.str();
+}
+
+/** C++ type holding a value, NULL for CHARN */
+static const char *value_type(TypeCode type) {
+    switch (type) {
+        case INT8_TC: return "int8_t";
+        case INT16_TC:
+        case CHARDICT_TC: return "int16_t";
+        case INT32_TC: return "int32_t";
+        case INT64_TC:
+        case DATE_TC:
+        case TIME_TC:
+        case DATETIME_TC: return "int64_t";
+        case FLOAT32_TC: return "float";
+        case FLOAT64_TC: return "double";
+        default: return NULL;
+    }
+}
+
+static const char *compare_operator(SimdCompare compare) {
+    switch (compare) {
+        case SIMD_LT: return "<";
+        case SIMD_LE: return "<=";
+        case SIMD_EQ: return "==";
+        case SIMD_NE: return "!=";
+        case SIMD_GT: return ">";
+        default: return ">=";
+    }
+}
+
+/**
+ * generate source of a pipeline
+ * @retval false a filter type is not supported
+ */
+static bool generate(const PipelineShape &shape, std::string &source) {
+    int64_t out_size = 0;
+    for (size_t ii = 0; ii < shape.outputs.size(); ii++)
+        out_size += shape.outputs[ii].size;
+    std::ostringstream os;
+    os << "// generated pipeline, shape " << shape.key() << "\n"
+       << "#include <stdint.h>\n"
+       << "#include <string.h>\n"
+       << "template <typename T> static inline T load(const char *p) { T v; memcpy(&v, p, sizeof(T)); return v; }\n"
+       << "extern \"C\" int64_t aimdb_pipeline(char *const *slots, int64_t per_slot, int64_t begin, int64_t end,\n"
+       << "                                   const char *const *constants, char *out) {\n";
+    for (size_t ii = 0; ii < shape.filters.size(); ii++) {
+        const PipelineFilter &f = shape.filters[ii];
+        const char *type = value_type(f.type);
+        if (f.type == CHARN_TC)
+            os << "    const char *c" << ii << " = constants[" << ii << "];\n";
+        else if (type != NULL)
+            os << "    const " << type << " c" << ii << " = load<" << type << ">(constants[" << ii << "]);\n";
+        else
+            return false;
+    }
+    os << "    int64_t n = 0;\n"
+       << "    int64_t slot = begin / per_slot, pos = begin % per_slot;\n"
+       << "    for (int64_t r = begin; r < end; slot++, pos = 0) {\n"
+       << "        const char *base = slots[slot];\n"
+       << "        int64_t stop = per_slot - pos < end - r ? per_slot : pos + (end - r);\n"
+       << "        for (; pos < stop; pos++, r++) {\n"
+       << "            const char *row = base + pos * " << shape.record_size << "L;\n"
+       << "            if (row[" << shape.record_size - 1 << "] != 'Y') continue;\n";
+    for (size_t ii = 0; ii < shape.filters.size(); ii++) {
+        const PipelineFilter &f = shape.filters[ii];
+        const char *op = compare_operator(f.compare);
+        if (f.type == CHARN_TC)
+            os << "            if (!(strncmp(row + " << f.offset << ", c" << ii << ", " << f.size << ") " << op << " 0)) continue;\n";
+        else
+            os << "            if (!(load<" << value_type(f.type) << ">(row + " << f.offset << ") " << op << " c" << ii << ")) continue;\n";
+    }
+    os << "            char *o = out + n * " << out_size << "L;\n";
+    int64_t pos = 0;
+    for (size_t ii = 0; ii < shape.outputs.size(); ii++) {
+        const PipelineOutput &o = shape.outputs[ii];
+        if (o.offset < 0)
+            os << "            memcpy(o + " << pos << ", &row, sizeof(row));\n";
+        else
+            os << "            memcpy(o + " << pos << ", row + " << o.offset << ", " << o.size << ");\n";
+        pos += o.size;
+    }
+    os << "            n++;\n"
+       << "        }\n"
+       << "    }\n"
+       << "    return n;\n"
+       << "}\n";
+    source = os.str();
+    return true;
+}
+
+/** hash of generated source, names its shared object */
+static std::string source_hash(const std::string &source) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t ii = 0; ii < source.size(); ii++) {
+        h ^= (uint8_t) source[ii];
+        h *= 1099511628211ULL;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) h);
+    return buffer;
+}
+
+/** whether a path is a file or directory of this user that no one else can write */
+static bool owned(const std::string &path, bool directory) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || st.st_uid != getuid())
+        return false;
+    if (directory)
+        return S_ISDIR(st.st_mode) && (st.st_mode & 077) == 0;
+    return S_ISREG(st.st_mode) && (st.st_mode & 022) == 0;
+}
+
+/** make an empty file of a unique name ending with suffix, see mkstemps */
+static std::string make_temp(const std::string &dir, const char *suffix) {
+    std::string name = dir + "/tmp_XXXXXX" + suffix;
+    int fd = mkstemps(&name[0], strlen(suffix));
+    if (fd < 0)
+        return "";
+    close(fd);
+    return name;
+}
+
+/**
+ * compile source into a shared object unless it is already on disk, then load it,
+ * shared objects are kept in a directory of this user only, others could plant code there.
+ * @param  source C++ source of the pipeline
+ * @param  reason why it failed, set on failure
+ * @retval != NULL the pipeline function
+ * @retval == NULL failure
+ */
+static PipelineFunc build(const std::string &source, std::string &reason) {
+    const char *dir_env = getenv("AIMDB_JIT_DIR");
+    const char *cache_env = getenv("XDG_CACHE_HOME");
+    const char *cxx_env = getenv("AIMDB_CXX");
+    std::string dir = dir_env != NULL ? dir_env
+        : cache_env != NULL ? std::string(cache_env) + "/aimdb_jit"
+        : "/tmp/aimdb_jit-" + std::to_string(getuid());
+    std::string cxx = cxx_env != NULL ? cxx_env : "g++";
+    mkdir(dir.c_str(), 0700);
+    if (!owned(dir, true)) {
+        reason = dir + " is not a private directory of this user";
+        return NULL;
+    }
+    std::string so = dir + "/pipe_" + source_hash(source) + ".so";
+    if (!owned(so, false)) {
+        // build under unique names, then move in place, other processes see a whole file
+        std::string cc = make_temp(dir, ".cc");
+        std::string tmp = make_temp(dir, ".so");
+        FILE *fp = cc.empty() ? NULL : fopen(cc.c_str(), "w");
+        if (fp == NULL || tmp.empty()) {
+            if (fp != NULL)
+                fclose(fp);
+            unlink(cc.c_str());
+            unlink(tmp.c_str());
+            reason = "can not create files in " + dir;
+            return NULL;
+        }
+        fputs(source.c_str(), fp);
+        fclose(fp);
+        std::string cmd = cxx + " -O2 -march=native -std=c++11 -shared -fPIC -o " + tmp + " " + cc + " 2>/dev/null";
+        int ret = system(cmd.c_str());
+        unlink(cc.c_str());
+        if (ret != 0 || chmod(tmp.c_str(), 0700) != 0 || rename(tmp.c_str(), so.c_str()) != 0) {
+            unlink(tmp.c_str());
+            reason = cxx + " failed";
+            return NULL;
+        }
+    }
+    void *handle = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        reason = "can not load " + so;
+        return NULL;
+    }
+    return (PipelineFunc) dlsym(handle, "aimdb_pipeline");
+}
+
+PipelineFunc compile_pipeline(const PipelineShape &shape) {
+    const char *jit = getenv("AIMDB_JIT");
+    if (jit != NULL && strcmp(jit, "0") == 0)
+        return NULL;
+    std::string key = shape.key();
+    {
+        std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+        auto it = pipeline_cache.find(key);
+        if (it != pipeline_cache.end())
+            return it->second;
+    }
+    // compiled without the lock, a shape compiled by two threads at once keeps the first function
+    std::string source, reason = "shape not supported";
+    PipelineFunc func = generate(shape, source) ? build(source, reason) : NULL;
+    std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+    if (func == NULL && !failure_reported) {
+        printf("[compile_pipeline][ERROR]: %s, pipeline is interpreted, later failures are not reported!\n", reason.c_str());
+        failure_reported = true;
+    }
+    return pipeline_cache.insert(std::make_pair(key, func)).first->second;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file    codegen.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  compile a scan pipeline (validation check, filters, projection) into a native function.
+ *
+ *  @basic usage:
+ *
+ *  (1) describe the pipeline with a PipelineShape, constants are not part of the shape.
+ *  (2) compile_pipeline generates C++ for the shape, compiles it with the local compiler
+ *      into a shared object and loads it with dlopen.
+ *  (3) functions are cached by shape in memory, shared objects are kept on disk by a hash of
+ *      their source, so a shape is compiled once even across runs.
+ *  (4) environment: AIMDB_JIT=0 disables compiling, AIMDB_CXX sets the compiler (default g++),
+ *      AIMDB_JIT_DIR sets the directory of shared objects (default $XDG_CACHE_HOME/aimdb_jit,
+ *      or /tmp/aimdb_jit-<uid>), it is used only if it is owned by the user and closed to others.
+ *
+ */
+
+#ifndef _CODEGEN_H
+#define _CODEGEN_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "simd.h"
+
+/** definition of PipelineFilter, a record column compared against a constant. */
+struct PipelineFilter {
+    int64_t offset;       /**< offset of the column in record    */
+    TypeCode type;        /**< type of the column                */
+    int64_t size;         /**< size of the column                */
+    SimdCompare compare;  /**< record value <compare> constant   */
+};
+
+/** definition of PipelineOutput, a column copied to the output row. */
+struct PipelineOutput {
+    int64_t offset;       /**< offset of the column in record, -1 for the record pointer */
+    int64_t size;         /**< size of the column                */
+};
+
+/** definition of PipelineShape, what a compiled scan pipeline does. */
+struct PipelineShape {
+    int64_t record_size = 0;                /**< size of a record, validation label is last */
+    std::vector<PipelineFilter> filters;    /**< and-ed filters, in evaluation order        */
+    std::vector<PipelineOutput> outputs;    /**< output columns, packed in this order       */
+    /**
+     * get a key identifying the shape, equal shapes share one compiled function
+     * @retval key text
+     */
+    std::string key(void) const;
+};
+
+/**
+ * compiled pipeline, scans records [begin, end) of a table
+ * @param slots     slots of table storage, see MStorage::getSlots
+ * @param per_slot  records per slot
+ * @param begin     first record rank
+ * @param end       end record rank
+ * @param constants one constant per filter, binary format of the column type
+ * @param out       output rows, room for end - begin rows
+ * @retval number of rows written
+ */
+typedef int64_t (*PipelineFunc)(char *const *slots, int64_t per_slot, int64_t begin, int64_t end,
+                                const char *const *constants, char *out);
+
+/**
+ * get the native function of a pipeline shape, compiling it on first use
+ * @param shape what the pipeline does
+ * @retval != NULL compiled function
+ * @retval == NULL compiling is disabled or failed, interpret the pipeline
+ */
+PipelineFunc compile_pipeline(const PipelineShape &shape);
+
+#endif
@@ -16,6 +16,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define DICT_MAX_VALUES (1024)  /**< most distinct values of a dictionary encoded CHARN column */
 
 /** data type code. */
 enum TypeCode {
@@ -30,6 +35,7 @@ enum TypeCode {
     DATE_TC,       /**< days from 1970-01-01 till current DATE */
     TIME_TC,       /**< seconds from 00:00:00 till current TIME */
     DATETIME_TC,   /**< seconds from 1970-01-01 00:00:00 till current DATETIME */
+    CHARDICT_TC,   /**< charn stored as int16 code of an order-preserving dictionary */
     MAXTYPE_TC
 };
 
@@ -438,6 +444,82 @@ class TypeCharN:public BasicType {
     }
 };
 
+/**
+ * definition of class TypeCharDict, a CHARN column stored as int16 codes, please refer to BasicType.
+ * value i of the sorted dictionary has code 2*i+1, a text not in the dictionary gets
+ * the even code between its neighbours, so codes compare like the texts they stand for.
+ * the dictionary is built once by load_data and never extended, even codes serve only as
+ * constants to compare with, RowTable rejects them in stored rows since they have no text.
+ */
+class TypeCharDict:public BasicType {
+  private:
+    int64_t d_text_size;                /**< N of CHARN(N)                    */
+    std::vector<std::string> d_values;  /**< distinct values, sorted by strncmp */
+  public:
+    /**
+     * constructor.
+     * @param text_size N of CHARN(N)
+     * @param values    distinct values of the column, at most DICT_MAX_VALUES
+     */
+    TypeCharDict(int64_t text_size, const std::vector<std::string> &values)
+        :BasicType(CHARDICT_TC, sizeof(int16_t)) {
+        d_text_size = text_size;
+        d_values = values;
+        std::sort(d_values.begin(), d_values.end(),
+                  [text_size](const std::string &l, const std::string &r) {
+            return strncmp(l.c_str(), r.c_str(), text_size) < 0;
+        });
+    }
+    /**
+     * get N of CHARN(N).
+     */
+    int64_t getTextSize(void) {
+        return d_text_size;
+    }
+    /**
+     * copy from data to dest.
+     */ 
+    int copy(void *dest, void *data) {
+        *(int16_t *) dest = *(int16_t *) data;
+        return b_type_size;
+    }
+    int formatTxt(void *dest, void *data) {
+        int16_t code = *(int16_t *) data;
+        const char *text = (code & 1) ? d_values[code >> 1].c_str() : "";
+        strncpy((char *) dest, text, d_text_size);
+        return d_text_size;
+    }
+    int formatBin(void *dest, void *data) {
+        int64_t lo = 0, hi = d_values.size();
+        while (lo < hi) {
+            int64_t mid = (lo + hi) / 2;
+            if (strncmp(d_values[mid].c_str(), (char *) data, d_text_size) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        bool found = lo < (int64_t) d_values.size()
+            && strncmp(d_values[lo].c_str(), (char *) data, d_text_size) == 0;
+        *(int16_t *) dest = (int16_t) (2 * lo + (found ? 1 : 0));
+        return b_type_size;
+    }
+    bool cmpLT(void *data1, void *data2) {
+        return *(int16_t *) data1 < *(int16_t *) data2;
+    }
+    bool cmpLE(void *data1, void *data2) {
+        return *(int16_t *) data1 <= *(int16_t *) data2;
+    }
+    bool cmpEQ(void *data1, void *data2) {
+        return *(int16_t *) data1 == *(int16_t *) data2;
+    }
+    bool cmpGT(void *data1, void *data2) {
+        return *(int16_t *) data1 > *(int16_t *) data2;
+    }
+    bool cmpGE(void *data1, void *data2) {
+        return *(int16_t *) data1 >= *(int16_t *) data2;
+    }
+};
+
 /** definition of class TypeDate,please refer to BasicType,it's same. */
 class TypeDate:public BasicType {
   public:
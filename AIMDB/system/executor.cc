@@ -11,13 +11,25 @@
  */
 
 #include "executor.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
 using namespace std;
 int64_t project_tabout_id = 456;
 int64_t tabout_id_hashjoin = 777;
+int64_t scan_tabout_id = 1234;
+int64_t groupby_tabout_id = 5678;
+TypeInt64 rowid_type;
 
-char ** hashjoin_cmpSrcB_tables = new char* [2];
 char * hashjoin_format_value = new char[128]; //Question
 
+/** operator trees by shape of query, see Executor::plan_key */
+static unordered_map<string, PreparedPlan> plan_cache;
+/** guards plan_cache and in_use of its plans, Executors may run in several threads */
+static mutex plan_cache_mutex;
+
 //------------structure of our operator tree-----------
 /*                      result_table
                               |
@@ -81,6 +93,33 @@ int64_t round2(int64_t size) {
     return result;
 }
 
+/** get buffer size of a ResultTable holding at least one row of row_length */
+int64_t row_buffer_size(int64_t row_length) {
+    return row_length > 1024 ? round2(row_length) : 1024;
+}
+
+/** row id pseudo columns use negative object ids, they never clash with catalog objects */
+int64_t rowid_oid(int64_t table_oid) {
+    return -table_oid;
+}
+
+/** longest text formatTxt writes for a value of a type, not counting a terminating zero */
+static int64_t text_size(BasicType *type) {
+    if (type->getTypeCode() == CHARDICT_TC)
+        return ((TypeCharDict *) type)->getTextSize();
+    return max(type->getTypeSize(), (int64_t) TYPE_TEXT_SIZE);
+}
+
+/** equality of two columns, texts of different dictionaries are compared decoded */
+bool link_equal(BasicType *type_a, char *value_a, BasicType *type_b, char *value_b) {
+    if (type_a == type_b || (type_a->getTypeCode() != CHARDICT_TC && type_b->getTypeCode() != CHARDICT_TC))
+        return type_a->cmpEQ(value_a, value_b);
+    std::vector<char> text_a(text_size(type_a) + 1, 0), text_b(text_size(type_b) + 1, 0);
+    type_a->formatTxt(text_a.data(), value_a);
+    type_b->formatTxt(text_b.data(), value_b);
+    return strcmp(text_a.data(), text_b.data()) == 0;
+}
+
 /** get hash number */
 uint32_t gethash(char *key, BasicType * type) {
     uint32_t hash = 0;
@@ -89,76 +128,347 @@ uint32_t gethash(char *key, BasicType * type) {
     return hash;
 }
 
+double estimate_selectivity(Condition *condi) {
+    Column *col = (Column *)g_catalog.getObjByName(condi->column.name);
+    ColumnStats *stats = (col == NULL || condi->compare == LINK) ? NULL : g_catalog.getColumnStats(col->getOid());
+    if (stats == NULL) {
+        switch (condi->compare) {
+            case EQ:
+            case LINK:
+                return SELECTIVITY_EQ;
+            case NE:
+                return 1 - SELECTIVITY_EQ;
+            case LT:
+            case LE:
+            case GT:
+            case GE:
+                return SELECTIVITY_RANGE;
+            default:
+                return 1;
+        }
+    }
+    char value[1024];
+    col->getDataType()->formatBin(value, condi->value);
+    double valid = stats->row_count > 0 ? (double)(stats->row_count - stats->invalid_count) / stats->row_count : 0;
+    switch (condi->compare) {
+        case EQ:
+            return valid * stats->eqFraction(value);
+        case NE:
+            return valid * (1 - stats->eqFraction(value));
+        case LT:
+            return valid * stats->ltFraction(value, false);
+        case LE:
+            return valid * stats->ltFraction(value, true);
+        case GT:
+            return valid * (1 - stats->ltFraction(value, true));
+        case GE:
+            return valid * (1 - stats->ltFraction(value, false));
+        default:
+            return 1;
+    }
+}
+
+int64_t estimate_distinct(int64_t col_oid, int64_t rows) {
+    ColumnStats *stats = g_catalog.getColumnStats(col_oid);
+    int64_t distinct = (stats != NULL && stats->distinct < rows) ? stats->distinct : rows;
+    return distinct > 0 ? distinct : 1;
+}
+
 /** exeutor function */
 int Executor::exec(SelectQuery *query, ResultTable *result)
 {
     if(query != NULL) {
-		int join_count = 0; // number of join req
 		count = 0;          // number of records 
 		timesin= 0;         // times comming in this function
-
-		int64_t filter_tid[4] = { -1, -1, -1, -1 }; // init of filter 
-		int64_t having_tid[4] = { -1, -1, -1, -1 }; // init of having
-        int64_t joinA_tid[4] = { -1, -1, -1, -1 };
-        int64_t joinB_tid[4] = { -1, -1, -1, -1 };
-		Condition *join_cond[4];                    // condtions 
-
-		this->filter_tid = filter_tid; // init of filter 
-		this->having_tid = having_tid; // init of having
-        this->joinA_tid = joinA_tid;
-        this->joinB_tid = joinB_tid;
-        this->join_cond = join_cond;
-        this->join_count = join_count;
-
-		this->count_join_link_number(query);
-		
-        this->find_table(query);
-
-        this->find_having_conditions(query);
-
-		// build the operator tree
-		Operator *Op[4];
-
-        this->build_op_tree(Op, query);
+        this->limit = query->limit;
+        // statistics of tables changed a lot are renewed before any estimate reads them
+        std::vector<int64_t> stats_versions(query->from_number, -1);
+        for (int i = 0; i < query->from_number; i++) {
+            Object *table = g_catalog.getObjByName(query->from_table[i].name);
+            if (table != NULL) {
+                g_catalog.refreshTable(table->getOid());
+                stats_versions[i] = g_catalog.getStatsVersion(table->getOid());
+            }
+        }
+        this->close();
+        string key = plan_key(query);
+        bool known = false;
+        Operator *stale_op = NULL;
+        {
+            lock_guard<mutex> lock(plan_cache_mutex);
+            auto cached = plan_cache.find(key);
+            known = cached != plan_cache.end();
+            if (known && !cached->second.in_use) {
+                if (cached->second.stats_versions == stats_versions) {
+                    this->plan = &cached->second;
+                    this->plan->in_use = true;
+                }
+                else {
+                    // planned with statistics renewed since, planned again below
+                    stale_op = cached->second.top_op;
+                    plan_cache.erase(cached);
+                    known = false;
+                }
+            }
+        }
+        if (stale_op != NULL)
+            stale_op->close();
+        if (this->plan != NULL) {
+            // same shape as an earlier query, rerun its tree with constants of this one
+            for (size_t i = 0; i < this->plan->scans.size(); i++)
+                this->plan->scans[i]->bind(query);
+            top_op = this->plan->top_op;
+            top_op->init();
+        }
+        else {
+            int join_count = 0; // number of join req
+
+            int64_t filter_tid[4] = { -1, -1, -1, -1 }; // init of filter 
+            int64_t having_tid[4] = { -1, -1, -1, -1 }; // init of having
+            int64_t joinA_tid[4] = { -1, -1, -1, -1 };
+            int64_t joinB_tid[4] = { -1, -1, -1, -1 };
+            Condition *join_cond[4];                    // condtions 
+
+            this->filter_tid = filter_tid; // init of filter 
+            this->having_tid = having_tid; // init of having
+            this->joinA_tid = joinA_tid;
+            this->joinB_tid = joinB_tid;
+            this->join_cond = join_cond;
+            this->join_count = join_count;
+
+            this->count_join_link_number(query);
+
+            this->find_table(query);
+
+            this->find_having_conditions(query);
+
+            // build the operator tree
+            Operator *Op[4];
+
+            this->build_op_tree(Op, query);
+            if (top_op != NULL && !known) {
+                lock_guard<mutex> lock(plan_cache_mutex);
+                if (plan_cache.size() < PLAN_CACHE_SIZE && plan_cache.find(key) == plan_cache.end()) {
+                    this->plan = &plan_cache[key];
+                    this->plan->top_op = top_op;
+                    this->plan->scans = this->scans;
+                    this->plan->stats_versions = stats_versions;
+                    this->plan->in_use = true;
+                }
+            }
+        }
 	}
-    // build result table to store result
+    if (top_op == NULL)
+        return false;
+    // build result table to store result, kept over the batches of a query
     int col_num = (int) top_op->getTableOut()->getColumns().size();
     timesin ++;
-    auto row_pattern =top_op->getTableOut()->getRPattern();
-    result_type = new BasicType *[col_num];
-    for(int i=0; i < col_num; i++)
-        result_type[i] = row_pattern.getColumnType(i);
-
-    //clear result table
-    if (timesin > 1)
-        result->shut();
-
-    result->init(result_type, col_num, 2048); 
-    ResultTable final_tmp_result;
+    if (timesin == 1) {
+        auto row_pattern =top_op->getTableOut()->getRPattern();
+        result_type = new BasicType *[col_num];
+        for(int i=0; i < col_num; i++)
+            result_type[i] = row_pattern.getColumnType(i);
+        int64_t row_size = 0;
+        for(int i=0; i < col_num; i++)
+            row_size += result_type[i]->getTypeSize();
+        result->init(result_type, col_num, std::max((int64_t) RESULT_BLOCK_SIZE, round2(row_size)));
+    }
     result->row_number = 0; 
-    final_tmp_result.init(result_type, col_num , 2048); 
 
-    // write result table 
-    while(result->row_number < 1024/result->row_length && top_op->get_Next(&final_tmp_result)){  
-        for(int j = 0; j < col_num; j++){
-            char* buf = final_tmp_result.get_RC(0, j);
-            result->write_RC(result->row_number, j, buf);
-        }
+    // write result table, the top operator writes each row in place, blocks are linked as rows come
+    ResultTable row_view = *result;
+    while(result->row_number < EXEC_BATCH_ROWS && (limit <= 0 || count + result->row_number < limit)){  
+        row_view.buffer = result->reserveRow();
+        if (row_view.buffer == NULL || !top_op->get_Next(&row_view))
+            break;
         result->row_number ++;
     }
     count += result->row_number;
 
     // 	ENDS return and close  
     if(result->row_number == 0) {
-        top_op->close();
+        this->close();
         printf("record count %ld\n",count);
         return false;
     }
     return true;
 }
 
+string Executor::plan_key(SelectQuery *query)
+{
+    string key = to_string(query->database_id);
+    auto add_columns = [&key](const char *tag, int num, RequestColumn *cols) {
+        key += tag;
+        for (int i = 0; i < num; i++)
+            key += string(cols[i].name) + "/" + to_string(cols[i].aggrerate_method) + ",";
+    };
+    // constants are parameters, only the column and compare method of a condition count
+    auto add_conditions = [&key](const char *tag, Conditions &conds) {
+        key += tag;
+        for (int i = 0; i < conds.condition_num; i++) {
+            Condition &c = conds.condition[i];
+            key += string(c.column.name) + "/" + to_string(c.compare);
+            key += c.compare == LINK ? "/" + string(c.value) + "," : ",";
+        }
+    };
+    add_columns("|select:", query->select_number, query->select_column);
+    key += "|from:";
+    for (int i = 0; i < query->from_number; i++)
+        key += string(query->from_table[i].name) + ",";
+    add_conditions("|where:", query->where);
+    add_columns("|groupby:", query->groupby_number, query->groupby);
+    add_conditions("|having:", query->having);
+    add_columns("|orderby:", query->orderby_number, query->orderby);
+    key += "|limit:" + to_string(query->limit);
+    return key;
+}
+
+double Executor::estimate_join_rows(double rows_a, double rows_b, int cond, SelectQuery *query)
+{
+    RowTable *table_a = (RowTable *)g_catalog.getObjByName(query->from_table[this->joinA_tid[cond]].name);
+    RowTable *table_b = (RowTable *)g_catalog.getObjByName(query->from_table[this->joinB_tid[cond]].name);
+    Column *col_a = (Column *)g_catalog.getObjByName(this->join_cond[cond]->column.name);
+    Column *col_b = (Column *)g_catalog.getObjByName(this->join_cond[cond]->value);
+    ColumnStats *stats_a = g_catalog.getColumnStats(col_a->getOid());
+    ColumnStats *stats_b = g_catalog.getColumnStats(col_b->getOid());
+    double distinct;
+    if (stats_a != NULL && stats_b != NULL)
+        distinct = (double)max(stats_a->distinct, stats_b->distinct);
+    else
+        distinct = (double)min(table_a->getRecordNum(), table_b->getRecordNum());
+    if (distinct < 1)
+        distinct = 1;
+    double rows = rows_a * rows_b / distinct;
+    return rows > 1 ? rows : 1;
+}
+
+bool Executor::choose_join_order(Operator **Op, SelectQuery *query, int *order)
+{
+    int perm[4] = {0, 1, 2, 3};
+    double best_cost = -1;
+    do {
+        bool joined[4] = {false, false, false, false};
+        joined[perm[0]] = true;
+        double rows = (double)Op[perm[0]]->getEstimatedRows();
+        double cost = 0;
+        int joined_num;
+        for (joined_num = 1; joined_num < query->from_number; joined_num++) {
+            int next = perm[joined_num];
+            double in_rows = (double)Op[next]->getEstimatedRows();
+            double out_rows = -1;
+            for (int i = 0; i < this->join_count; i++) {
+                int tid_a = this->joinA_tid[i];
+                int tid_b = this->joinB_tid[i];
+                if (tid_a == next && joined[tid_b]) {
+                    out_rows = out_rows < 0 ? this->estimate_join_rows(in_rows, rows, i, query) : out_rows * SELECTIVITY_EQ;
+                }
+                else if (tid_b == next && joined[tid_a]) {
+                    out_rows = out_rows < 0 ? this->estimate_join_rows(rows, in_rows, i, query) : out_rows * SELECTIVITY_EQ;
+                }
+            }
+            if (out_rows < 0)  // no cross products
+                break;
+            // hash join builds on the smaller input and probes with the larger one
+            cost += 2 * min(rows, in_rows) + max(rows, in_rows) + out_rows;
+            rows = out_rows;
+            joined[next] = true;
+        }
+        if (joined_num == query->from_number && (best_cost < 0 || cost < best_cost)) {
+            best_cost = cost;
+            for (int i = 0; i < query->from_number; i++)
+                order[i] = perm[i];
+        }
+    } while (next_permutation(perm, perm + query->from_number));
+    return best_cost >= 0;
+}
+
+Operator *Executor::build_join_tree(Operator **Op, SelectQuery *query)
+{
+    if (this->join_count == 0)
+        return Op[0];
+    int order[4];
+    if (!this->choose_join_order(Op, query, order)) {
+        printf("[Executor][ERROR][build_join_tree]: tables are not connected by join conditions!\n");
+        return NULL;
+    }
+    bool joined[4] = {false, false, false, false};
+    bool used[4] = {false, false, false, false};
+    Operator *tree = Op[order[0]];
+    joined[order[0]] = true;
+    for (int joined_num = 1; joined_num < query->from_number; joined_num++) {
+        // the first join condition between the tree and the next table drives the hash join
+        int other = order[joined_num];
+        int next = -1;
+        for (int i = 0; i < this->join_count; i++) {
+            if (!used[i] && ((this->joinA_tid[i] == other && joined[this->joinB_tid[i]]) ||
+                             (this->joinB_tid[i] == other && joined[this->joinA_tid[i]]))) {
+                next = i;
+                break;
+            }
+        }
+        double rows_a = (double)(this->joinA_tid[next] == other ? Op[other] : tree)->getEstimatedRows();
+        double rows_b = (double)(this->joinA_tid[next] == other ? tree : Op[other])->getEstimatedRows();
+        Operator *inputs[2] = {tree, Op[other]};
+        tree = new HashJoin(2, inputs, 1, this->join_cond[next]);
+        tree->setEstimatedRows((int64_t)this->estimate_join_rows(rows_a, rows_b, next, query));
+        used[next] = true;
+        joined[other] = true;
+    }
+    // conditions closing a cycle are checked on the joined rows
+    for (int i = 0; i < this->join_count; i++)
+        if (!used[i])
+            tree = new Filter(tree, this->join_cond[i]);
+    return tree;
+}
+
+int64_t Executor::required_columns(SelectQuery *query, Table *table, bool with_select, int64_t *col_oids)
+{
+    int64_t col_tot = 0;
+    char *names[24];
+    int name_num = 0;
+    // filter conditions are evaluated by Scan on the records, only join columns go up
+    for (int i = 0; i < query->where.condition_num; i++) {
+        if (query->where.condition[i].compare == LINK) {
+            names[name_num++] = query->where.condition[i].column.name;
+            names[name_num++] = query->where.condition[i].value;
+        }
+    }
+    if (with_select) {
+        for (int i = 0; i < query->select_number; i++)
+            names[name_num++] = query->select_column[i].name;
+        for (int i = 0; i < query->groupby_number; i++)
+            names[name_num++] = query->groupby[i].name;
+        for (int i = 0; i < query->orderby_number; i++)
+            names[name_num++] = query->orderby[i].name;
+    }
+    for (int i = 0; i < name_num; i++) {
+        Object *col = g_catalog.getObjByName(names[i]);
+        if (col == NULL)
+            continue;
+        int64_t oid = col->getOid();
+        if (table->getColumnRank(oid) < 0 || find(col_oids, col_oids + col_tot, oid) != col_oids + col_tot)
+            continue;
+        col_oids[col_tot++] = oid;
+    }
+    return col_tot;
+}
+
+Executor::~Executor()
+{
+    this->close();
+}
+
 int Executor::close() 
 {
+    // a cached tree is kept for the next query of its shape, others are closed
+    if (this->plan != NULL) {
+        lock_guard<mutex> lock(plan_cache_mutex);
+        this->plan->in_use = false;
+    }
+    else if (this->top_op != NULL)
+        this->top_op->close();
+    this->plan = NULL;
+    this->top_op = NULL;
     return 0;
 }
 
@@ -191,54 +501,109 @@ int ResultTable::init(BasicType *col_types[], int col_num, int64_t capicity) {
     }
     row_capicity = (int)(capicity / row_length);
     row_number   = 0;
+    blocks       = NULL;
+    blocks_size  = 0;
+    block_number = 1;
     return 0;
 }
 
-/** print */
-int ResultTable::print (void) {
-    int row = 0;
-    int ii = 0;
-    char buffer[1024];
-    char *p = NULL; 
-    while(row < row_number) {
-        for( ; ii < column_number-1; ii++) {
-            p = get_RC(row, ii);
-            column_type[ii]->formatTxt(buffer, p);
-            printf("%s\t", buffer);
+/** reserve row */
+char* ResultTable::reserveRow (void) {
+    int block = row_number / row_capicity;
+    if (block >= block_number) {
+        if ((int64_t)((block_number + 1) * sizeof(char *)) > blocks_size) {
+            char *p = NULL;
+            int64_t size = blocks_size > 0 ? blocks_size * 2 : 64;
+            if (g_memory.alloc(p, size) != size) {
+                printf ("[ResultTable][ERROR][reserveRow]: blocks allocate error!\n");
+                return NULL;
+            }
+            char **grown = (char **) p;
+            grown[0] = buffer;
+            for (int ii = 1; ii < block_number; ii++)
+                grown[ii] = blocks[ii];
+            if (blocks)
+                g_memory.free ((char *)blocks, blocks_size);
+            blocks = grown;
+            blocks_size = size;
         }
-        p = get_RC(row, ii);
-        column_type[ii]->formatTxt(buffer, p);
-        printf("%s\n", buffer);
-        row ++; ii=0;
+        if (g_memory.alloc(blocks[block_number], buffer_size) != buffer_size) {
+            printf ("[ResultTable][ERROR][reserveRow]: buffer allocate error!\n");
+            return NULL;
+        }
+        block_number ++;
     }
-    return row;
+    return get_RC(row_number, 0) - offset[0];
+}
+
+/** print */
+int ResultTable::print (void) {
+    return dump(stdout);
 }
 
 /** dump result to fp*/
 int ResultTable::dump(FILE *fp) {
-    int row = 0;
-    int ii = 0;
-    char *buffer;
-    g_memory.alloc(buffer, 128);
-    char *p = NULL; 
-   while(row < row_number) {
-        for( ; ii < column_number-1; ii++) {
-            p = get_RC(row, ii);
-            column_type[ii]->formatTxt(buffer, p);
-            fprintf(fp,"%s\t", buffer);
+    std::vector<char> text;
+    format(text);
+    fwrite(text.data(), 1, text.size(), fp);
+    return row_number;
+}
+
+/** format result */
+int64_t ResultTable::format(std::vector<char> &text) {
+    std::vector<TypeOps> ops(column_number);
+    for (int ii = 0; ii < column_number; ii++)
+        ops[ii] = type_ops(column_type[ii]);
+    int64_t thread_max = std::thread::hardware_concurrency();
+    int64_t thread_num = max((int64_t) 1, min(thread_max, (int64_t) row_number / RESULT_THREAD_ROWS));
+    if (thread_num == 1) {
+        formatRows(ops, 0, row_number, text);
+        return text.size();
+    }
+    // each thread formats a range of rows, texts are joined in row order
+    std::vector<std::vector<char>> parts(thread_num);
+    std::vector<std::thread> threads;
+    for (int64_t t = 1; t < thread_num; t++)
+        threads.push_back(std::thread(&ResultTable::formatRows, this, std::cref(ops),
+                                      (int) (row_number * t / thread_num), (int) (row_number * (t + 1) / thread_num), std::ref(parts[t])));
+    formatRows(ops, 0, (int) (row_number / thread_num), text);
+    for (int64_t t = 1; t < thread_num; t++) {
+        threads[t - 1].join();
+        text.insert(text.end(), parts[t].begin(), parts[t].end());
+    }
+    return text.size();
+}
+
+/** format rows */
+void ResultTable::formatRows(const std::vector<TypeOps> &ops, int begin, int end, std::vector<char> &text) {
+    int64_t row_bound = 0;
+    for (int ii = 0; ii < column_number; ii++)
+        row_bound += text_size(column_type[ii]) + 1;
+    int64_t pos = 0;
+    for (int row = begin; row < end; row++) {
+        if (pos + row_bound > (int64_t) text.size())
+            text.resize(max((int64_t) text.size() * 2, pos + row_bound));
+        for (int ii = 0; ii < column_number; ii++) {
+            char *p = get_RC(row, ii);
+            if (ops[ii].format != NULL)
+                pos += ops[ii].format(&text[pos], p, ops[ii].size);
+            else {
+                // dictionary texts come from the type, kept up to their end like %s
+                text[pos] = '\0';
+                int64_t len = column_type[ii]->formatTxt(&text[pos], p);
+                pos += strnlen(&text[pos], max((int64_t) 0, min(len, text_size(column_type[ii]))));
+            }
+            text[pos++] = ii < column_number - 1 ? '\t' : '\n';
         }
-        p = get_RC(row, ii);
-        column_type[ii]->formatTxt(buffer, p);
-        fprintf(fp,"%s\n", buffer);
-        row ++; ii=0;
     }
-    g_memory.free(buffer,128);
-    return row;
+    text.resize(pos);
 }
 
 // this include checks, may decrease its speed
 char* ResultTable::get_RC(int row, int column) {
-    return buffer+ row*row_length+ offset[column];
+    if (row < row_capicity)
+        return buffer+ row*row_length+ offset[column];
+    return blocks[row / row_capicity] + (row % row_capicity) * row_length + offset[column];
 }
 
 /** write rc with data*/
@@ -257,9 +622,228 @@ int ResultTable::shut (void) {
     if (offset) {
         g_memory.free ((char*)offset, offset_size);
     }
+    for (int ii = 1; ii < block_number; ii++)
+        g_memory.free (blocks[ii], buffer_size);
+    if (blocks) {
+        g_memory.free ((char*)blocks, blocks_size);
+    }
+    blocks = NULL;
+    block_number = 1;
     return 0;
 }
 
+/** results of SUM over integers and COUNT */
+static TypeInt64 aggregate_int_type;
+/** results of SUM over floats and AVG */
+static TypeFloat64 aggregate_float_type;
+
+/** integer sums are kept in an int64 accumulator */
+template <typename T>
+static void start_int(char *acc, const char *value, int64_t size) {
+    int64_t sum = load_value<T>(value);
+    memcpy(acc, &sum, sizeof(int64_t));
+}
+
+template <typename T>
+static void update_int(char *const *entries, int64_t acc_offset, const char *const *rows, int64_t value_offset, int64_t num, int64_t size) {
+    for (int64_t i = 0; i < num; i++) {
+        char *acc = entries[i] + acc_offset;
+        int64_t sum = load_value<int64_t>(acc) + load_value<T>(rows[i] + value_offset);
+        memcpy(acc, &sum, sizeof(int64_t));
+    }
+}
+
+static void merge_int(char *acc, const char *other, int64_t size) {
+    int64_t sum = load_value<int64_t>(acc) + load_value<int64_t>(other);
+    memcpy(acc, &sum, sizeof(int64_t));
+}
+
+static void sum_int(const char *acc, int64_t count, char *out, int64_t size) {
+    memcpy(out, acc, sizeof(int64_t));
+}
+
+static void avg_int(const char *acc, int64_t count, char *out, int64_t size) {
+    double avg = count > 0 ? (double)load_value<int64_t>(acc) / count : 0;
+    memcpy(out, &avg, sizeof(double));
+}
+
+/** float sums are kept as a double sum and its Kahan compensation */
+static inline void kahan_add(double *state, double value) {
+    double y = value - state[1];
+    double t = state[0] + y;
+    state[1] = (t - state[0]) - y;
+    state[0] = t;
+}
+
+template <typename T>
+static void start_float(char *acc, const char *value, int64_t size) {
+    double state[2] = {(double)load_value<T>(value), 0};
+    memcpy(acc, state, sizeof(state));
+}
+
+template <typename T>
+static void update_float(char *const *entries, int64_t acc_offset, const char *const *rows, int64_t value_offset, int64_t num, int64_t size) {
+    for (int64_t i = 0; i < num; i++) {
+        double state[2];
+        memcpy(state, entries[i] + acc_offset, sizeof(state));
+        kahan_add(state, (double)load_value<T>(rows[i] + value_offset));
+        memcpy(entries[i] + acc_offset, state, sizeof(state));
+    }
+}
+
+static void merge_float(char *acc, const char *other, int64_t size) {
+    double state[2], other_state[2];
+    memcpy(state, acc, sizeof(state));
+    memcpy(other_state, other, sizeof(other_state));
+    kahan_add(state, other_state[0]);
+    kahan_add(state, -other_state[1]);
+    memcpy(acc, state, sizeof(state));
+}
+
+static void sum_float(const char *acc, int64_t count, char *out, int64_t size) {
+    memcpy(out, acc, sizeof(double));
+}
+
+static void avg_float(const char *acc, int64_t count, char *out, int64_t size) {
+    double avg = count > 0 ? load_value<double>(acc) / count : 0;
+    memcpy(out, &avg, sizeof(double));
+}
+
+static void count_rows(const char *acc, int64_t count, char *out, int64_t size) {
+    memcpy(out, &count, sizeof(int64_t));
+}
+
+/** MAX and MIN keep a value of the column type */
+static void start_value(char *acc, const char *value, int64_t size) {
+    memcpy(acc, value, size);
+}
+
+template <typename T, bool Max>
+static void update_value(char *const *entries, int64_t acc_offset, const char *const *rows, int64_t value_offset, int64_t num, int64_t size) {
+    for (int64_t i = 0; i < num; i++) {
+        char *acc = entries[i] + acc_offset;
+        const char *value = rows[i] + value_offset;
+        if (Max ? load_value<T>(acc) < load_value<T>(value) : load_value<T>(value) < load_value<T>(acc))
+            memcpy(acc, value, sizeof(T));
+    }
+}
+
+template <typename T, bool Max>
+static void merge_value(char *acc, const char *other, int64_t size) {
+    if (Max ? load_value<T>(acc) < load_value<T>(other) : load_value<T>(other) < load_value<T>(acc))
+        memcpy(acc, other, sizeof(T));
+}
+
+template <bool Max>
+static void update_text(char *const *entries, int64_t acc_offset, const char *const *rows, int64_t value_offset, int64_t num, int64_t size) {
+    for (int64_t i = 0; i < num; i++) {
+        char *acc = entries[i] + acc_offset;
+        const char *value = rows[i] + value_offset;
+        int c = strncmp(acc, value, size);
+        if (Max ? c < 0 : c > 0)
+            memcpy(acc, value, size);
+    }
+}
+
+template <bool Max>
+static void merge_text(char *acc, const char *other, int64_t size) {
+    int c = strncmp(acc, other, size);
+    if (Max ? c < 0 : c > 0)
+        memcpy(acc, other, size);
+}
+
+static void result_value(const char *acc, int64_t count, char *out, int64_t size) {
+    memcpy(out, acc, size);
+}
+
+/** set kernels of SUM or AVG over a numeric type */
+template <typename T>
+static void sum_ops(AggregateOps &ops, bool avg, bool is_float) {
+    ops.state_size = AGG_STATE_SIZE;
+    if (is_float) {
+        ops.out_type = &aggregate_float_type;
+        ops.start = start_float<T>;
+        ops.update = update_float<T>;
+        ops.merge = merge_float;
+        ops.result = avg ? avg_float : sum_float;
+    }
+    else {
+        ops.out_type = avg ? (BasicType *)&aggregate_float_type : &aggregate_int_type;
+        ops.start = start_int<T>;
+        ops.update = update_int<T>;
+        ops.merge = merge_int;
+        ops.result = avg ? avg_int : sum_int;
+    }
+}
+
+/** set kernels of MAX or MIN over a type with a native order */
+template <typename T, bool Max>
+static void value_ops(AggregateOps &ops) {
+    ops.start = start_value;
+    ops.update = update_value<T, Max>;
+    ops.merge = merge_value<T, Max>;
+    ops.result = result_value;
+}
+
+template <bool Max>
+static void extreme_ops(AggregateOps &ops, TypeCode type_code) {
+    switch (type_code) {
+        case INT8_TC: value_ops<int8_t, Max>(ops); break;
+        case INT16_TC:
+        case CHARDICT_TC: value_ops<int16_t, Max>(ops); break;
+        case INT32_TC: value_ops<int32_t, Max>(ops); break;
+        case INT64_TC:
+        case DATE_TC:
+        case TIME_TC:
+        case DATETIME_TC: value_ops<int64_t, Max>(ops); break;
+        case FLOAT32_TC: value_ops<float, Max>(ops); break;
+        case FLOAT64_TC: value_ops<double, Max>(ops); break;
+        case CHARN_TC:
+            ops.start = start_value;
+            ops.update = update_text<Max>;
+            ops.merge = merge_text<Max>;
+            ops.result = result_value;
+            break;
+        default: break;
+    }
+}
+
+AggregateOps aggregate_ops(AggrerateMethod method, BasicType *type) {
+    AggregateOps ops;
+    ops.out_type = type;
+    ops.size = type->getTypeSize();
+    TypeCode type_code = type->getTypeCode();
+    switch (method) {
+        case COUNT:
+            ops.out_type = &aggregate_int_type;
+            ops.result = count_rows;
+            break;
+        case SUM:
+        case AVG:
+            switch (type_code) {
+                case INT8_TC: sum_ops<int8_t>(ops, method == AVG, false); break;
+                case INT16_TC: sum_ops<int16_t>(ops, method == AVG, false); break;
+                case INT32_TC: sum_ops<int32_t>(ops, method == AVG, false); break;
+                case INT64_TC: sum_ops<int64_t>(ops, method == AVG, false); break;
+                case FLOAT32_TC: sum_ops<float>(ops, method == AVG, true); break;
+                case FLOAT64_TC: sum_ops<double>(ops, method == AVG, true); break;
+                default: break;
+            }
+            break;
+        case MAX:
+        case MIN:
+            ops.state_size = ops.size;
+            if (method == MAX)
+                extreme_ops<true>(ops, type_code);
+            else
+                extreme_ops<false>(ops, type_code);
+            break;
+        default:
+            break;
+    }
+    return ops;
+}
+
 //---operators implementation---
 
 //-  ---------Scan--------------
@@ -268,31 +852,281 @@ Scan::Scan(char*tablename) {
     this->table_in[0] = table;
     this->table_out = table;
     this->col_num = table->getColumns().size();
+    for (int64_t i = 0; i < col_num; i++)
+        this->col_offset.push_back(table->getRPattern().getColumnOffset(i));
+    this->estimated_rows = table->getRecordNum();
+}
+
+Scan::Scan(char *tablename, int64_t col_tot, int64_t *col_oids, bool with_rowid) {
+    RowTable *table= (RowTable *)g_catalog.getObjByName(tablename);
+    this->table_in[0] = table;
+
+    string cname_head = "tmp_scan_table";
+    char *cname = constchar2char((cname_head + to_string(scan_tabout_id)).c_str());
+    table_out = new RowTable(scan_tabout_id++, cname);
+    table_out->init();
+    RPattern *new_RPattern = &table_out->getRPattern();
+    RPattern *old_RPattern = &table->getRPattern();
+    new_RPattern->init(col_tot + (with_rowid ? 1 : 0));
+    for (int64_t i = 0; i < col_tot; i++) {
+        int64_t rank = table->getColumnRank(col_oids[i]);
+        new_RPattern->addColumn(old_RPattern->getColumnType(rank));
+        table_out->addColumn(col_oids[i]);
+        this->col_offset.push_back(old_RPattern->getColumnOffset(rank));
+    }
+    if (with_rowid) {
+        new_RPattern->addColumn(&rowid_type);
+        table_out->addColumn(rowid_oid(table->getOid()));
+        this->col_offset.push_back(-1);
+    }
+    this->col_num = this->col_offset.size();
+    this->estimated_rows = table->getRecordNum();
+}
+
+void Scan::addPredicate(Condition *condi, int param) {
+    this->predicates.push_back(Predicate(this->table_in[0], condi));
+    this->predicates.back().param = param;
+    int64_t rows = (int64_t)(this->estimated_rows * this->predicates.back().selectivity);
+    this->estimated_rows = rows > 0 ? rows : 1;
+}
+
+void Scan::bind(SelectQuery *query) {
+    for (size_t i = 0; i < this->predicates.size(); i++) {
+        int param = this->predicates[i].param;
+        if (param >= 0)
+            this->predicates[i].bind(param < 4 ? query->where.condition[param].value : query->having.condition[param - 4].value);
+    }
 }
 
 bool Scan::init(void) {
     this->current_row = 0;
+    this->batch.resize(SCAN_BATCH_SIZE);
+    this->batch_num = 0;
+    this->batch_pos = 0;
+    if (this->pipeline == NULL && this->table_in[0]->getRecordNum() >= COMPILE_MIN_ROWS)
+        this->compile();
     return true;
 }
 
-bool Scan::get_Next(ResultTable *result) {
-    if (is_End()) return false;
-    char* buffer ;
-    g_memory.alloc(buffer, 128);
-    if(!this->writeRow(buffer, result)){
+bool Scan::compile(void) {
+    RowTable *table = this->table_in[0];
+    PipelineShape shape;
+    shape.record_size = table->getRPattern().getRowSize();
+    // predicates keep their estimated order, a compiled pipeline does not reorder
+    stable_sort(this->predicates.begin(), this->predicates.end(), [](const Predicate &l, const Predicate &r) {
+        return l.rank() < r.rank();
+    });
+    this->constants.clear();
+    for (size_t i = 0; i < this->predicates.size(); i++) {
+        Predicate &p = this->predicates[i];
+        shape.filters.push_back({p.offset, p.type->getTypeCode(), p.type->getTypeSize(), p.simd_op});
+        this->constants.push_back(p.value.data());
+    }
+    this->compiled_length = 0;
+    for (int64_t i = 0; i < this->col_num; i++) {
+        int64_t size = this->table_out->getRPattern().getColumnType(i)->getTypeSize();
+        shape.outputs.push_back({this->col_offset[i], size});
+        this->compiled_length += size;
+    }
+    this->pipeline = compile_pipeline(shape);
+    if (this->pipeline == NULL)
         return false;
+    this->compiled_rows.resize(SCAN_BATCH_SIZE * this->compiled_length);
+    return true;
+}
+
+bool Scan::nextBatch(void) {
+    RowTable *table = this->table_in[0];
+    int64_t record_num = table->getRecordNum();
+    // skip blocks whose zone map rules out some predicate
+    int64_t block = this->current_row / ZONE_ROWS;
+    while (this->current_row < record_num) {
+        bool skip = false;
+        for (size_t i = 0; i < this->predicates.size() && !skip; i++)
+            skip = this->predicates[i].skipZone(table, block);
+        if (!skip)
+            break;
+        this->current_row = ++block * ZONE_ROWS;
+    }
+    if (this->current_row >= record_num)
+        return false;
+    int64_t end = min(min(this->current_row + SCAN_BATCH_SIZE, (block + 1) * ZONE_ROWS), record_num);
+    MStorage &storage = table->getMStorage();
+    if (this->pipeline != NULL) {
+        this->batch_num = this->pipeline(storage.getSlots(), storage.getRecordPerSlot(), this->current_row, end,
+                                         this->constants.data(), this->compiled_rows.data());
+        this->batch_pos = 0;
+        this->current_row = end;
+        return true;
+    }
+    int64_t valid_pos = table->getRPattern().getRowSize() - 1;
+    this->batch_num = 0;
+    this->batch_pos = 0;
+    // predicates on packed columns are tested first, only records passing them are read
+    this->tested.assign(this->predicates.size(), 0);
+    this->block_mask.assign(ZONE_ROWS / 64, ~0ULL);
+    for (size_t i = 0; i < this->predicates.size(); i++)
+        tested[i] = end - this->current_row == ZONE_ROWS
+            && this->predicates[i].selectPacked(table, block, this->block_mask.data());
+    const uint64_t *bits = this->block_mask.data();
+    for (int64_t i = this->current_row; i < end; i++) {
+        int64_t pos = i - this->current_row;
+        if (((bits[pos >> 6] >> (pos & 63)) & 1) == 0)
+            continue;
+        char *row = storage.getRow(i);
+        if (row[valid_pos] == 'Y')
+            this->batch[this->batch_num++] = row;
+    }
+    this->current_row = end;
+    for (size_t i = 0; i < this->predicates.size() && this->batch_num > 0; i++) {
+        if (!this->tested[i])
+            this->batch_num = this->predicates[i].select(this->batch.data(), this->batch_num);
+    }
+    if (this->predicates.size() > 1) {
+        stable_sort(this->predicates.begin(), this->predicates.end(), [](const Predicate &l, const Predicate &r) {
+            return l.rank() < r.rank();
+        });
     }
-    this->current_row++;
-    g_memory.free(buffer, 128);
     return true;
 }
 
+bool Scan::get_Next(ResultTable *result) {
+    while (this->batch_pos >= this->batch_num) {
+        if (!this->nextBatch())
+            return false;
+    }
+    if (this->pipeline != NULL) {
+        memcpy(result->get_RC(0, 0), &this->compiled_rows[this->batch_pos++ * this->compiled_length], this->compiled_length);
+        return true;
+    }
+    return this->writeRow(this->batch[this->batch_pos++], result);
+}
+
 bool Scan::is_End(void) {
-    return this->equalornot();
+    return this->batch_pos >= this->batch_num && this->current_row >= this->table_in[0]->getRecordNum();
 }
 
 bool Scan::close() { return true; }
 
+//----------Predicate-----------
+/** copy a column of records into a contiguous vector */
+template <typename T>
+static void gather_column(char **rows, int64_t row_num, int64_t offset, char *column) {
+    T *dest = (T *)column;
+    for (int64_t i = 0; i < row_num; i++)
+        memcpy(dest + i, rows[i] + offset, sizeof(T));
+}
+
+/** keep rows whose CHARN column satisfies cmp(strncmp(column, constant), 0) */
+template <typename Cmp>
+static int64_t select_text(char **rows, int64_t row_num, int64_t offset, const char *value, int64_t size, Cmp cmp) {
+    int64_t kept = 0;
+    for (int64_t i = 0; i < row_num; i++) {
+        rows[kept] = rows[i];
+        kept += cmp(strncmp(rows[i] + offset, value, size), 0) ? 1 : 0;
+    }
+    return kept;
+}
+
+static int64_t select_charn(char **rows, int64_t row_num, int64_t offset, const char *value, int64_t size, CompareMethod compare) {
+    switch (compare) {
+        case LT: return select_text(rows, row_num, offset, value, size, less<int>());
+        case LE: return select_text(rows, row_num, offset, value, size, less_equal<int>());
+        case EQ: return select_text(rows, row_num, offset, value, size, equal_to<int>());
+        case NE: return select_text(rows, row_num, offset, value, size, not_equal_to<int>());
+        case GT: return select_text(rows, row_num, offset, value, size, greater<int>());
+        case GE: return select_text(rows, row_num, offset, value, size, greater_equal<int>());
+        default: return row_num;
+    }
+}
+
+Predicate::Predicate(RowTable *table, Condition *condi) {
+    Object *col = g_catalog.getObjByName(condi->column.name);
+    int64_t rank = table->getColumnRank(col->getOid());
+    this->compare = condi->compare;
+    this->type = table->getRPattern().getColumnType(rank);
+    this->column_rank = rank;
+    this->offset = table->getRPattern().getColumnOffset(rank);
+    this->value.assign(max(this->type->getTypeSize(), (int64_t)sizeof(int64_t)) + 1, '\0');
+    this->type->formatBin(&this->value[0], condi->value);
+    switch (this->compare) {
+        case LT: this->simd_op = SIMD_LT; break;
+        case LE: this->simd_op = SIMD_LE; break;
+        case EQ: this->simd_op = SIMD_EQ; break;
+        case NE: this->simd_op = SIMD_NE; break;
+        case GT: this->simd_op = SIMD_GT; break;
+        default: this->simd_op = SIMD_GE; break;
+    }
+    this->cost = this->type->getTypeCode() == CHARN_TC ? 4 : 1;
+    this->selectivity = estimate_selectivity(condi);
+}
+
+void Predicate::bind(const char *text) {
+    fill(this->value.begin(), this->value.end(), '\0');
+    this->type->formatBin(&this->value[0], (void *)text);
+}
+
+int64_t Predicate::select(char **rows, int64_t row_num) {
+    int64_t kept = 0;
+    TypeCode type_code = this->type->getTypeCode();
+    if (type_code == CHARN_TC)
+        kept = select_charn(rows, row_num, offset, value.data(), type->getTypeSize(), compare);
+    else {
+        // numeric and date columns: gather a column vector, compare it with SIMD, compact by bitmask
+        int64_t size = this->type->getTypeSize();
+        this->column.resize(row_num * size);
+        this->mask.resize((row_num + 63) / 64);
+        switch (size) {
+            case 1: gather_column<int8_t>(rows, row_num, offset, column.data()); break;
+            case 2: gather_column<int16_t>(rows, row_num, offset, column.data()); break;
+            case 4: gather_column<int32_t>(rows, row_num, offset, column.data()); break;
+            default: gather_column<int64_t>(rows, row_num, offset, column.data()); break;
+        }
+        if (!simd_compare(type_code, column.data(), row_num, simd_op, value.data(), mask.data())) {
+            printf("[Predicate][ERROR][select]: type not support!\n");
+            return 0;
+        }
+        const uint64_t *bits = this->mask.data();
+        for (int64_t i = 0; i < row_num; i++) {
+            rows[kept] = rows[i];
+            kept += (bits[i >> 6] >> (i & 63)) & 1;
+        }
+    }
+    this->evaluated += row_num;
+    this->passed += kept;
+    return kept;
+}
+
+bool Predicate::skipZone(RowTable *table, int64_t block) {
+    char *min = NULL, *max = NULL;
+    if (!table->getZone(this->column_rank, block, min, max))
+        return false;
+    char *val = &this->value[0];
+    switch (this->compare) {
+        case LT: return !this->type->cmpLT(min, val);
+        case LE: return this->type->cmpGT(min, val);
+        case EQ: return this->type->cmpLT(val, min) || this->type->cmpGT(val, max);
+        case NE: return this->type->cmpEQ(min, val) && this->type->cmpEQ(max, val);
+        case GT: return !this->type->cmpGT(max, val);
+        case GE: return this->type->cmpLT(max, val);
+        default: return false;
+    }
+}
+
+bool Predicate::selectPacked(RowTable *table, int64_t block, uint64_t *block_mask) {
+    this->mask.resize(ZONE_ROWS / 64);
+    if (!table->packedCompare(this->column_rank, block, this->simd_op, &this->value[0], this->mask.data()))
+        return false;
+    int64_t kept = 0;
+    for (int64_t i = 0; i < ZONE_ROWS / 64; i++) {
+        kept += __builtin_popcountll(this->mask[i]);
+        block_mask[i] &= this->mask[i];
+    }
+    this->evaluated += ZONE_ROWS;
+    this->passed += kept;
+    return true;
+}
+
 //----------Filter--------------
 Filter::Filter(Operator *Op, Condition *condi) {
     this->prior_op = Op;
@@ -305,7 +1139,20 @@ Filter::Filter(Operator *Op, Condition *condi) {
     Object *col = g_catalog.getObjByName(condi->column.name);
     this->col_rank = this->table_out->getColumnRank(col->getOid());
     this->value_type = this->table_out->getRPattern().getColumnType(this->col_rank);
-    this->value_type->formatBin(this->value, condi->value); //get fixed value
+    if (this->compare_method == LINK) {
+        // join condition left over by the planner, compare two columns of the same row
+        Object *link_col = g_catalog.getObjByName(condi->value);
+        this->link_rank = this->table_out->getColumnRank(link_col->getOid());
+        this->link_type = this->table_out->getRPattern().getColumnType(this->link_rank);
+        if (typed_comparable(this->value_type, this->link_type))
+            this->value_ops = type_ops(this->value_type);
+    }
+    else {
+        this->value_type->formatBin(this->value, condi->value); //get fixed value
+        this->value_ops = type_ops(this->value_type);
+    }
+    int64_t rows = (int64_t)(prior_op->getEstimatedRows() * estimate_selectivity(condi));
+    this->estimated_rows = rows > 0 ? rows : 1;
 }
 
 bool Filter::init() {
@@ -314,25 +1161,16 @@ bool Filter::init() {
 
 bool Filter::get_Next(ResultTable *result) {
     bool flag = false;
-    char * DEBUG_A;
-    g_memory.alloc(DEBUG_A, 128);
-    char * DEBUG_B;
-    g_memory.alloc(DEBUG_B, 128);
     while (!flag) {
         if (prior_op->is_End()) break;
         if (!prior_op->get_Next(&this->result)) return false;
         char* cmpSrcA_ptr = this->result.get_RC(0, this->col_rank); //variable value
-        char* cmpSrcB_ptr = this->value; //fixed value
-        this->value_type->formatTxt(DEBUG_A, cmpSrcA_ptr);
-        this->value_type->formatTxt(DEBUG_B, cmpSrcB_ptr);
-        
+        char* cmpSrcB_ptr = this->link_rank < 0 ? this->value : this->result.get_RC(0, this->link_rank);
         flag = this->compare_exec(cmpSrcA_ptr, cmpSrcB_ptr);
     }
     if(!this->resCopy(flag, result)){
         return false;
     }
-        g_memory.free(DEBUG_A, 128);
-        g_memory.free(DEBUG_B, 128);
     return flag;
 }
 
@@ -355,13 +1193,32 @@ Project::Project(Operator *Op, int64_t col_tot, RequestColumn *cols_name) {
     int in_colnum = Op->getTableOut()->getColumns().size();
     this->ResInit(in_colnum);
     
+    auto &in_cols = Op->getTableOut()->getColumns();
     for (int i = 0; i < col_tot; i++) {
         Object *col = g_catalog.getObjByName(cols_name[i].name);
         this->col_rank[i] = Op->getTableOut()->getColumnRank(col->getOid());
+        this->rowid_rank[i] = -1;
+        if (this->col_rank[i] >= 0) {
+            this->col_type[i] = this->in_RP.getColumnType(this->col_rank[i]);
+            continue;
+        }
+        // not carried by input, materialize it from the record of its table
+        for (int k = 0; k < (int)in_cols.size(); k++) {
+            if (in_cols[k] >= 0)
+                continue;
+            RowTable *base = (RowTable *)g_catalog.getObjById(-in_cols[k]);
+            int64_t base_rank = base->getColumnRank(col->getOid());
+            if (base_rank >= 0) {
+                this->rowid_rank[i] = k;
+                this->base_offset[i] = base->getRPattern().getColumnOffset(base_rank);
+                this->col_type[i] = base->getRPattern().getColumnType(base_rank);
+                break;
+            }
+        }
     }
     
     string cname_head = "tmp_project_table";
-    char *cname = constchar2char(strcat(constchar2char(cname_head.c_str()), to_string(project_tabout_id).c_str()));
+    char *cname = constchar2char((cname_head + to_string(project_tabout_id)).c_str());
     
     RowTable *project_table = (RowTable *)g_catalog.getObjByName(cname);
     if (project_table != NULL){
@@ -370,13 +1227,12 @@ Project::Project(Operator *Op, int64_t col_tot, RequestColumn *cols_name) {
     table_out = new RowTable(project_tabout_id++, cname); 
     table_out->init();
     RPattern *new_RPattern = &this->table_out->getRPattern();
-    RPattern *old_RPattern = &Op->getTableOut()->getRPattern();
-    auto &cols_id = table_in[0]->getColumns();
     new_RPattern->init(col_tot);
     for (int i = 0; i < col_tot; i++) {
-        new_RPattern->addColumn(old_RPattern->getColumnType(col_rank[i]));
-        table_out->addColumn(cols_id[col_rank[i]]);
+        new_RPattern->addColumn(col_type[i]);
+        table_out->addColumn(g_catalog.getObjByName(cols_name[i].name)->getOid());
     }
+    this->estimated_rows = Op->getEstimatedRows();
 }
 
 bool Project::init(){
@@ -413,7 +1269,7 @@ HashJoin::HashJoin(int operator_num, Operator **Op, int cond_num, Condition *con
     this->MakeOrder();
     //make up a temporary table_out
     string cname_head = "tmp_hashjoin_table";
-    char *cname = constchar2char(strcat(constchar2char(cname_head.c_str()), to_string(tabout_id_hashjoin).c_str()));
+    char *cname = constchar2char((cname_head + to_string(tabout_id_hashjoin)).c_str());
     RowTable *hashjoin_table = (RowTable *)g_catalog.getObjByName(cname);
     if (hashjoin_table != NULL) hashjoin_table->shut();
     table_out = new RowTable(tabout_id_hashjoin++, cname); 
@@ -437,102 +1293,245 @@ HashJoin::HashJoin(int operator_num, Operator **Op, int cond_num, Condition *con
             table_out->addColumn(cols_id[j]);
         }
     }
-    this->result.init(in_col_type, col_num[0]);
+    this->result.init(in_col_type, col_num[0], row_buffer_size(table_in[0]->getRPattern().getRowSize()));
+    // every probe row is expected to find its partner, as with a foreign key join
+    this->estimated_rows = this->Op[0]->getEstimatedRows();
+}
+
+/** hash of a join key mixed so that its high bits pick the spill partition, text keys hash to 32 bits */
+static inline uint64_t join_partition_hash(int64_t hash) {
+    return (uint64_t) hash * 0x9E3779B97F4A7C15ULL;
 }
 
 bool HashJoin::init(void) {
     for(int i = 0; i <operator_num; i++)
     if (!Op[i]->init()) return false;
+    this->releaseBuild();
     col_B_type = new BasicType * [col_num[1]];
     for (int i=0; i < col_num[1]; i++)
         col_B_type[i] = table_in[1]->getRPattern().getColumnType(i);
+    build_row.init(col_B_type, col_num[1], row_buffer_size(table_in[1]->getRPattern().getRowSize()));
+    
+    BasicType * this_type = table_in[1]->getRPattern().getColumnType(col_B_rank);
+    this->value_type = table_in[0]->getRPattern().getColumnType(col_A_rank);
+    // keys of the same type are hashed and compared in binary, others as text
+    this->key_ops = TypeOps();
+    if (typed_comparable(this->value_type, this_type))
+        this->key_ops = type_ops(this_type);
+    return build(NULL, 0, Op[1]->getEstimatedRows());
+}
+
+bool HashJoin::build(SpillFile *source, int64_t depth, int64_t expected_rows) {
+    if (hash_table != NULL) {
+        delete hash_table;
+        hash_table = NULL;
+        build_rows.shut();
+    }
+    // rows of table B are copied one after another, a slot keeps at least 64 rows
+    int64_t slot_size = round2(build_row.row_length * 64);
+    if (!build_rows.init(build_row.row_length, 1L << 6, slot_size < (1L << 16) ? (1L << 16) : slot_size))
+        return false;
     
     char * value;
-    char * format_value;
-    g_memory.alloc(format_value,128);
-    hash_table = new HashTable(200000, 10, 0);
-    while (!Op[1]->is_End()) {
-        row_i[col_B_row].init(col_B_type, col_num[1]);
-        Op[1]->get_Next(&row_i[col_B_row]);
-        
-        value = row_i[col_B_row].get_RC(0, col_B_rank);
-        BasicType * this_type = table_in[1]->getRPattern().getColumnType(col_B_rank);
-
-        this_type->formatTxt(format_value, value);
-        uint32_t hash_value = gethash(format_value, this_type);
-        hash_table->add(hash_value, (char *)&row_i[col_B_row]);
-        
+    BasicType * this_type = col_B_type[col_B_rank];
+    int64_t build_estimate = expected_rows > 0 ? expected_rows : 1;
+    int64_t budget_rows = spill_budget() / (build_row.row_length + 16);
+    // one cell per distinct key of the rows kept in memory, the table grows if the estimate is short
+    int64_t table_rows = min(build_estimate, budget_rows);
+    int64_t build_keys = min(estimate_distinct(col_B_oid, build_estimate), table_rows);
+    hash_table = new HashTable(build_keys, (double)table_rows / build_keys, 0);
+    col_B_row = 0;
+    this->depth = depth;
+    build_parts.clear();
+    probe_parts.clear();
+    for (int64_t p = 0; p < SPILL_PARTITIONS; p++)
+        part_rows[p] = 0;
+    // partitions expected beyond the memory budget go to disk from the first row on
+    bool splittable = depth < SPILL_MAX_DEPTH;
+    if (splittable && build_estimate > budget_rows) {
+        for (int64_t p = SPILL_PARTITIONS * budget_rows / build_estimate; p < SPILL_PARTITIONS; p++)
+            if (!spillPart(p)) return false;
+    }
+    if (source != NULL && !source->rewind())
+        return false;
+    while (true) {
+        if (source == NULL) {
+            if (Op[1]->is_End() || !Op[1]->get_Next(&build_row)) break;
+        } else {
+            const char *row = source->next();
+            if (row == NULL) break;
+            memcpy(build_row.buffer, row, build_row.row_length);
+        }
+        value = build_row.buffer + build_row.offset[col_B_rank];
+        int64_t hash = keyHash(this_type, value);
+        int64_t p = spill_partition(join_partition_hash(hash), depth);
+        if (!build_parts.empty() && build_parts[p] != NULL) {
+            if (!build_parts[p]->append(build_row.buffer)) return false;
+            continue;
+        }
+        char *row = NULL;
+        if (build_rows.allocRow(row) < 0)
+            return false;
+        memcpy(row, build_row.buffer, build_row.row_length);
+        if (!hash_table->add(hash, row))
+            return false;
+        part_rows[p]++;
         col_B_row++ ;
+        if (col_B_row > 2 * table_rows) {
+            table_rows *= 4;
+            if (!hash_table->resize(hash_table->table_size * 4))
+                return false;
+        }
+        // over budget despite the estimate, later rows of the largest partition kept go to disk
+        if (splittable && col_B_row > budget_rows) {
+            int64_t largest = -1;
+            for (int64_t q = 0; q < SPILL_PARTITIONS; q++)
+                if ((build_parts.empty() || build_parts[q] == NULL) && (largest < 0 || part_rows[q] > part_rows[largest]))
+                    largest = q;
+            if (largest >= 0 && !spillPart(largest)) return false;
+        }
     }
-    this->value_type = table_in[0]->getRPattern().getColumnType(col_A_rank);
-    g_memory.free(format_value, 128);
+    match_rows.clear();
+    match_pos = 0;
     
     return true;
 }
 
+bool HashJoin::spillPart(int64_t p) {
+    if (build_parts.empty()) {
+        build_parts.assign(SPILL_PARTITIONS, NULL);
+        probe_parts.assign(SPILL_PARTITIONS, NULL);
+    }
+    build_parts[p] = new SpillFile();
+    probe_parts[p] = new SpillFile();
+    return build_parts[p]->open(build_row.row_length) && probe_parts[p]->open(this->result.row_length);
+}
+
+size_t HashJoin::probeMatch(char *key) {
+    char *candidate[HASHJOIN_PROBE_CAPACITY];
+    match_rows.clear();
+    match_pos = 0;
+    int64_t hash_result = keyHash(value_type, key);
+    int64_t key_offset = build_row.offset[col_B_rank];
+    int ret = hash_table->probe(hash_result, candidate, HASHJOIN_PROBE_CAPACITY);
+    while (true) {
+        int num = ret < 0 ? HASHJOIN_PROBE_CAPACITY : ret;
+        for (int i = 0; i < num; i++) {
+            bool equal = key_ops.compare != NULL
+                ? key_ops.compare(key, candidate[i] + key_offset, key_ops.size) == 0
+                : link_equal(value_type, key, col_B_type[col_B_rank], candidate[i] + key_offset);
+            if (equal)
+                match_rows.push_back(candidate[i]);
+        }
+        if (ret >= 0) break;
+        ret = hash_table->probe_contd(hash_result, -ret, candidate, HASHJOIN_PROBE_CAPACITY);
+    }
+    return match_rows.size();
+}
+
+int64_t HashJoin::keyHash(BasicType *type, char *key) {
+    if (key_ops.hash != NULL)
+        return (int64_t)(key_ops.hash(key, key_ops.size) >> 1);
+    type->formatTxt(hashjoin_format_value, key);
+    return gethash(hashjoin_format_value, type);
+}
+
 bool HashJoin::get_Next(ResultTable *result) {
-    bool flag = false;
-    char* cmpSrcA_ptr;
-    char* cmpSrcB_ptr;
-    ResultTable * row_i;
-    while (!flag) {
-        if (Op[0]->is_End() || !Op[0]->get_Next(&this->result)) break;
-        cmpSrcA_ptr = this->result.get_RC(0, col_A_rank); 
-        
-        BasicType * value_type = table_in[0]->getRPattern().getColumnType(col_A_rank);
-        
-        value_type->formatTxt(hashjoin_format_value, cmpSrcA_ptr);
-        
-        uint32_t hash_result = gethash(hashjoin_format_value, value_type);
-        int64_t cmpSrcB_table_num = hash_table->probe(hash_result, hashjoin_cmpSrcB_tables, 2);
-        for (int i=0; i<cmpSrcB_table_num; i++) {
-            row_i = (ResultTable *) hashjoin_cmpSrcB_tables[i];
-            cmpSrcB_ptr = row_i->get_RC(0, col_B_rank);
-            value_type->formatTxt(hashjoin_format_value, cmpSrcB_ptr);
-            if (this->value_type->cmpEQ(cmpSrcA_ptr, cmpSrcB_ptr)) {
-                flag = true;
-                break;
+    // rows of table B may share one join value, output all of them before reading next probe row
+    while (match_pos >= match_rows.size()) {
+        if (!nextProbe()) return false;
+        char *key = this->result.get_RC(0, col_A_rank);
+        if (!build_parts.empty()) {
+            // rows of table B of a spilled partition are joined later, those kept before it spilled now
+            int64_t p = spill_partition(join_partition_hash(keyHash(value_type, key)), depth);
+            if (build_parts[p] != NULL && !probe_parts[p]->append(this->result.buffer)) return false;
+            if (part_rows[p] == 0) {
+                match_rows.clear();
+                match_pos = 0;
+                continue;
             }
         }
-        if (flag) break;
+        probeMatch(key);
     }
-    if (flag) {
-        char* buffer;
-        for (int j = 0; j < col_num[0]; j++) {
-            buffer = this->result.get_RC(0L, j);
-            if (!result->write_RC(0, j, buffer))
-            {
-                return false;
-            } 
+    return this->WriteRow(match_rows[match_pos++], result);
+}
+
+bool HashJoin::nextProbe(void) {
+    while (true) {
+        if (probe_file == NULL) {
+            if (!Op[0]->is_End() && Op[0]->get_Next(&this->result)) return true;
+        } else {
+            const char *row = probe_file->next();
+            if (row != NULL) {
+                memcpy(this->result.buffer, row, this->result.row_length);
+                return true;
+            }
         }
-        for (int j = 0; j < col_num[1]; j++) {
-            buffer = row_i->get_RC(0L, j);
-            if (!result->write_RC(0, col_num[0] + j, buffer))
-            {
-                return false;
-            } 
+        if (!nextPartition()) return false;
+    }
+}
+
+bool HashJoin::nextPartition(void) {
+    for (size_t p = 0; p < build_parts.size(); p++) {
+        // a partition missing rows of either table joins to nothing
+        if (build_parts[p] != NULL && build_parts[p]->getRowNum() > 0 && probe_parts[p]->getRowNum() > 0)
+            pending.push_back({build_parts[p], probe_parts[p], depth + 1});
+        else {
+            delete build_parts[p];
+            delete probe_parts[p];
         }
     }
-    return flag;
+    build_parts.clear();
+    probe_parts.clear();
+    delete probe_file;
+    probe_file = NULL;
+    if (pending.empty())
+        return false;
+    SpilledJoin next = pending.back();
+    pending.pop_back();
+    probe_file = next.probe;
+    bool built = build(next.build, next.depth, next.build->getRowNum());
+    delete next.build;
+    return built && probe_file->rewind();
 }
 
-bool HashJoin::close(void) {
+void HashJoin::releaseBuild(void) {
+    for (size_t p = 0; p < build_parts.size(); p++) {
+        delete build_parts[p];
+        delete probe_parts[p];
+    }
+    build_parts.clear();
+    probe_parts.clear();
+    for (size_t i = 0; i < pending.size(); i++) {
+        delete pending[i].build;
+        delete pending[i].probe;
+    }
+    pending.clear();
+    delete probe_file;
+    probe_file = NULL;
+    if (hash_table == NULL)
+        return;
     delete hash_table;
+    hash_table = NULL;
+    build_row.shut();
+    build_rows.shut();
+    delete [] col_B_type;
+}
+
+bool HashJoin::close(void) {
+    this->releaseBuild();
     result.shut();
     delete []in_col_type;
-    for (int i = 0; i < col_B_row; i++) {
-        row_i[i].shut();
-    }
     for (int i = 0; i < operator_num; i++) 
         if (!Op[i]->close()) return false;
     for (int i = 0; i < operator_num; i++) 
         delete Op[i];
-    delete [] col_B_type;
     return true;
 }
 
 bool HashJoin::is_End(void)  {
-    return Op[0]->is_End();
+    return match_pos >= match_rows.size() && Op[0]->is_End()
+        && probe_file == NULL && build_parts.empty() && pending.empty();
 }
 
 
@@ -551,85 +1550,333 @@ OrderBy::OrderBy(Operator *op_ptr, int64_t order_by_num, RequestColumn *cols_nam
     int64_t in_col_num = this->get_prior_operator()->getTableOut()->getColumns().size();
     this->init_col_type();
     this->result.init(in_col_type, in_col_num);
-    this->re.init(in_col_type, in_col_num, 1024*32);
-
-    this->row_length =this->get_rpattern().getRowSize(); 
+    this->row_length = this->result.row_length;
 
     this->in_cols_name = cols_name;
     this->init_col();
+    this->estimated_rows = op_ptr->getEstimatedRows();
 }
+
 bool OrderBy::init(){
-    char* buffer;
-    int i = 0;
-    this->get_prior_operator()->init();
+    if(!this->get_prior_operator()->init())
+        return false;
+    this->finish_merge();
+    this->drop_spilled();
+    int64_t budget = spill_budget();
+    std::vector<char> input;
+    int64_t num = 0, total = 0;
     while(this->check_not_end())
     {
-        this->write_result_col(i, buffer);
-        i++;
+        input.insert(input.end(), this->result.buffer, this->result.buffer + this->row_length);
+        num++;
+        total++;
+        // sorting takes about twice the input, a full buffer becomes a sorted run on disk
+        if ((int64_t)input.size() * 2 >= budget) {
+            if (!this->spill_run(input.data(), num))
+                return false;
+            input.clear();
+            num = 0;
+        }
     }
-    this->record_size = i;  
-    quick_sort(re.buffer, 0, record_size-1);
-    index= 0;
+    this->record_size = total;
+    index = 0;
+    part = 0;
+    if (!this->spilled.empty()) {
+        if (num > 0 && !this->spill_run(input.data(), num))
+            return false;
+        std::vector<char>().swap(input);
+        std::vector<char>().swap(this->runs);
+        std::vector<char>().swap(this->keys);
+        // runs are merged in passes until one merge reads them all
+        while (this->spilled.size() > SPILL_MERGE_FANIN) {
+            std::vector<SpillFile *> some(this->spilled.begin(), this->spilled.begin() + SPILL_MERGE_FANIN);
+            SpillFile *merged = new SpillFile();
+            SpillMerger pass;
+            this->spilled.push_back(merged);
+            if (!merged->open(this->row_length) || !pass.init(&this->sorter, some))
+                return false;
+            for (const char *row = pass.next(); row != NULL; row = pass.next()) {
+                if (!merged->append(row))
+                    return false;
+            }
+            for (size_t r = 0; r < some.size(); r++)
+                delete some[r];
+            this->spilled.erase(this->spilled.begin(), this->spilled.begin() + SPILL_MERGE_FANIN);
+        }
+        return this->spill_merger.init(&this->sorter, this->spilled);
+    }
+    this->sort_runs(input.data(), num);
+    // first partition is merged as get_Next reads it, the others meanwhile by their own threads
+    this->merger.init(this->runs.data(), this->keys.data(), this->row_length, this->sorter.getKeySize(), this->bounds[0], this->bounds[1]);
+    this->rows.resize((num - this->part_begin[1]) * this->row_length);
+    for(size_t p = 1; p + 1 < this->bounds.size(); p++)
+        this->mergers.push_back(std::thread(&OrderBy::merge_part, this, p));
     return true;
 }
 
-void OrderBy::quick_sort(char *buffer, int64_t left, int64_t right) {
-    if(left < right)
-    {
-        char *key =(char*) malloc(this->row_length) ;
-        memcpy( key, buffer + left*this->row_length, this->row_length);
-        int64_t low =left;
-        int64_t high = right;
-        this->low = low;
-        this->high = high;
-        this->key = key;
-        this->qsort_helper(buffer);
-        memcpy(buffer+this->low * this->row_length, this->key, this->row_length);
-        quick_sort(buffer,left, this->low-1);
-        quick_sort(buffer,this->low+1, right);
-        free(key);
-    }
-}
-
-int OrderBy::cmp(void*l, void*r)
-{    int i;
-    for(i = 0;i < order_by_num ;)
-    {
-        auto p =l+compare_col_offset[i];
-        auto q =r+compare_col_offset[i];
-        if(this->compare_col_type[i]->cmpEQ(p, q)){
-            i++;            
-        }
-        else{
-            return (this->compare_col_type[i]->cmpGT(p, q)) ? 2 : 0;
+bool OrderBy::spill_run(const char *input, int64_t num){
+    this->sort_runs(input, num);
+    SpillFile *run = new SpillFile();
+    this->spilled.push_back(run);
+    if (!run->open(this->row_length))
+        return false;
+    RunMerger all;
+    all.init(this->runs.data(), this->keys.data(), this->row_length, this->sorter.getKeySize(), this->bounds.front(), this->bounds.back());
+    for (const char *row = all.next(); row != NULL; row = all.next()) {
+        if (!run->append(row))
+            return false;
+    }
+    return true;
+}
+
+/** rank of first key of a sorted range not less than key */
+static int64_t lower_key(const char *keys, int64_t key_size, int64_t begin, int64_t end, const char *key) {
+    while (begin < end) {
+        int64_t mid = begin + (end - begin) / 2;
+        if (memcmp(keys + mid * key_size, key, key_size) < 0)
+            begin = mid + 1;
+        else
+            end = mid;
+    }
+    return begin;
+}
+
+void OrderBy::sort_runs(const char *input, int64_t num){
+    int64_t key_size = this->sorter.getKeySize();
+    int64_t run_num = (num + SORT_RUN_ROWS - 1) / SORT_RUN_ROWS;
+    this->runs.resize(num * this->row_length);
+    this->keys.resize(num * key_size);
+
+    //------threads take runs one at a time and sort them------
+    int64_t thread_max = std::thread::hardware_concurrency();
+    if (thread_max < 1)
+        thread_max = 1;
+    std::atomic<int64_t> next_run(0);
+    auto sort_some = [&]() {
+        for (int64_t run = next_run++; run < run_num; run = next_run++) {
+            int64_t begin = run * SORT_RUN_ROWS, n = min((int64_t)SORT_RUN_ROWS, num - begin);
+            this->sorter.sort(input + begin * row_length, n, &this->runs[begin * row_length], &this->keys[begin * key_size]);
         }
+    };
+    int64_t thread_num = max((int64_t)1, min(thread_max, run_num));
+    std::vector<std::thread> threads;
+    for (int64_t t = 1; t < thread_num; t++)
+        threads.push_back(std::thread(sort_some));
+    sort_some();
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    //------splitters sampled from all runs cut every run into partitions------
+    int64_t part_num = run_num > 1 ? min(thread_max, run_num) : 1;
+    std::vector<const char *> sample;
+    for (int64_t run = 0; run < run_num && part_num > 1; run++) {
+        int64_t begin = run * SORT_RUN_ROWS, n = min((int64_t)SORT_RUN_ROWS, num - begin);
+        for (int64_t k = 0; k < SORT_SAMPLE_KEYS; k++)
+            sample.push_back(&this->keys[(begin + n * k / SORT_SAMPLE_KEYS) * key_size]);
+    }
+    std::sort(sample.begin(), sample.end(), [key_size](const char *l, const char *r) { return memcmp(l, r, key_size) < 0; });
+    this->bounds.assign(part_num + 1, std::vector<int64_t>(run_num));
+    this->part_begin.assign(part_num + 1, 0);
+    for (int64_t run = 0; run < run_num; run++) {
+        int64_t begin = run * SORT_RUN_ROWS, end = min(begin + SORT_RUN_ROWS, num);
+        this->bounds[0][run] = begin;
+        this->bounds[part_num][run] = end;
+        for (int64_t p = 1; p < part_num; p++)
+            this->bounds[p][run] = lower_key(this->keys.data(), key_size, begin, end, sample[sample.size() * p / part_num]);
+        for (int64_t p = 1; p <= part_num; p++)
+            this->part_begin[p] += this->bounds[p][run] - begin;
+    }
+}
+
+void OrderBy::merge_part(int64_t p){
+    RunMerger part_merger;
+    part_merger.init(this->runs.data(), this->keys.data(), this->row_length, this->sorter.getKeySize(), this->bounds[p], this->bounds[p + 1]);
+    char *out = &this->rows[(this->part_begin[p] - this->part_begin[1]) * this->row_length];
+    for (const char *row = part_merger.next(); row != NULL; row = part_merger.next()) {
+        memcpy(out, row, this->row_length);
+        out += this->row_length;
     }
-    return 1;
 }
 
 bool OrderBy::get_Next(ResultTable *result)
 {
-    if(this->is_End())return false;
-    char *buffer;
-    if(!this->check_stop_get_Next(result, buffer)){
+    if(this->is_End())
         return false;
+    const char *row;
+    if (!this->spilled.empty()) {
+        row = this->spill_merger.next();
+        if (row == NULL) {
+            printf("[OrderBy][ERROR][get_Next]: spilled run ended early, %ld of %ld records read!\n",
+                   this->index, this->record_size);
+            this->index = this->record_size;
+            this->drop_spilled();
+            return false;
+        }
     }
+    else if (this->index < this->part_begin[1])
+        row = this->merger.next();
+    else {
+        // wait for the merge of the partition of this record
+        while (this->index >= this->part_begin[this->part + 1]) {
+            this->part++;
+            if (this->mergers[this->part - 1].joinable())
+                this->mergers[this->part - 1].join();
+        }
+        row = &this->rows[(this->index - this->part_begin[1]) * this->row_length];
+    }
+    memcpy(result->get_RC(0, 0), row, this->row_length);
     this->index ++;
+    // a cached tree keeps no spill files open between its queries
+    if (this->is_End())
+        this->drop_spilled();
     return true;
 }   
 
 bool OrderBy::is_End(){
-    return index == record_size;
+    return index >= record_size;
 } 
 
 bool OrderBy::close(){
+            this->finish_merge();
+            this->drop_spilled();
             int t = prior_op->close(); 
             delete prior_op;
             result.shut();
-            re.shut();
+            std::vector<char>().swap(runs);
+            std::vector<char>().swap(keys);
+            std::vector<char>().swap(rows);
             delete [] in_col_type;
             return t;
 }
+
+//------------------TopN------------------------------
+
+TopN::TopN(Operator *op_ptr, int64_t order_by_num, RequestColumn *cols_name, int64_t limit) {
+    this->prior_op = op_ptr;
+    this->limit = limit;
+    this->order_by_num = order_by_num;
+    this->table_in[0] = op_ptr->getTableOut();
+    this->table_out = op_ptr->getTableOut();
+    RPattern &rpattern = this->table_out->getRPattern();
+    this->col_num = this->table_out->getColumns().size();
+    this->in_col_type = new BasicType *[this->col_num];
+    for(int i = 0; i < this->col_num; i++)
+        this->in_col_type[i] = rpattern.getColumnType(i);
+    for(int i = 0; i < order_by_num; i++){
+        Object *col_ptr = g_catalog.getObjByName(cols_name[i].name);
+        this->compare_col_rank[i] = this->table_out->getColumnRank(col_ptr->getOid());
+        this->compare_col_ops[i] = type_ops(rpattern.getColumnType(compare_col_rank[i]));
+    }
+    this->estimated_rows = min(op_ptr->getEstimatedRows(), limit);
+}
+
+bool TopN::init(){
+    if(!prior_op->init())
+        return false;
+    if (this->built)
+        tmp_one.shut();
+    this->built = true;
+    this->tmp_one.init(this->in_col_type, this->col_num);
+    this->row_length = tmp_one.row_length;
+    for(int i = 0; i < order_by_num; i++)
+        this->compare_col_offset[i] = tmp_one.offset[compare_col_rank[i]];
+    int64_t thread_max = std::thread::hardware_concurrency();
+    if (thread_max < 1)
+        thread_max = 1;
+    this->heaps.assign(thread_max, std::vector<char>());
+
+    //------each thread keeps the first rows of a range of every chunk------
+    std::vector<char> chunk(SORT_CHUNK_ROWS * row_length);
+    int64_t chunk_num = SORT_CHUNK_ROWS;
+    while (chunk_num == SORT_CHUNK_ROWS) {
+        chunk_num = 0;
+        while (chunk_num < SORT_CHUNK_ROWS && !prior_op->is_End() && prior_op->get_Next(&tmp_one))
+            memcpy(&chunk[chunk_num++ * row_length], tmp_one.buffer, row_length);
+        int64_t thread_num = min(thread_max, chunk_num / SORT_THREAD_ROWS);
+        if (thread_num < 1)
+            thread_num = 1;
+        std::vector<std::thread> threads;
+        for (int64_t t = 1; t < thread_num; t++) {
+            int64_t begin = chunk_num * t / thread_num, end = chunk_num * (t + 1) / thread_num;
+            threads.push_back(std::thread(&TopN::rank_rows, this, &this->heaps[t], &chunk[begin * row_length], end - begin));
+        }
+        rank_rows(&this->heaps[0], chunk.data(), chunk_num / thread_num);
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+    }
+
+    //------rows kept by all threads are sorted, the first limit of them are the result------
+    std::vector<const char *> kept;
+    for (size_t t = 0; t < this->heaps.size(); t++) {
+        for (size_t off = 0; off < this->heaps[t].size(); off += row_length)
+            kept.push_back(&this->heaps[t][off]);
+    }
+    std::sort(kept.begin(), kept.end(), [this](const char *l, const char *r) { return this->less(l, r); });
+    this->row_num = min((int64_t)kept.size(), this->limit);
+    this->rows.resize(this->row_num * row_length);
+    for (int64_t r = 0; r < this->row_num; r++)
+        memcpy(&this->rows[r * row_length], kept[r], row_length);
+    this->heaps.clear();
+    this->index = 0;
+    return true;
+}
+
+void TopN::rank_rows(std::vector<char> *heap, const char *rows, int64_t num){
+    std::vector<char> &kept = *heap;
+    std::vector<char> tmp(row_length);
+    int64_t kept_num = kept.size() / row_length;
+    auto at = [&kept, this](int64_t i) { return &kept[i * row_length]; };
+    auto swap_rows = [&tmp, this](char *a, char *b) {
+        memcpy(tmp.data(), a, row_length);
+        memcpy(a, b, row_length);
+        memcpy(b, tmp.data(), row_length);
+    };
+    for (int64_t r = 0; r < num; r++) {
+        const char *row = rows + r * row_length;
+        if (kept_num < this->limit) {
+            // sift the new row up
+            kept.insert(kept.end(), row, row + row_length);
+            for (int64_t i = kept_num++; i > 0 && less(at((i - 1) / 2), at(i)); i = (i - 1) / 2)
+                swap_rows(at((i - 1) / 2), at(i));
+        }
+        else if (less(row, at(0))) {
+            // replace the last row in order and sift it down
+            memcpy(at(0), row, row_length);
+            for (int64_t i = 0, c = 1; c < kept_num; i = c, c = 2 * i + 1) {
+                if (c + 1 < kept_num && less(at(c), at(c + 1)))
+                    c++;
+                if (!less(at(i), at(c)))
+                    break;
+                swap_rows(at(i), at(c));
+            }
+        }
+    }
+}
+
+bool TopN::get_Next(ResultTable *result){
+    if (this->is_End())
+        return false;
+    memcpy(result->get_RC(0, 0), &this->rows[this->index * row_length], row_length);
+    this->index++;
+    return true;
+}
+
+bool TopN::is_End(){
+    return this->index >= this->row_num;
+}
+
+bool TopN::close(){
+    bool tmp = prior_op->close();
+    delete prior_op;
+    if (this->built)
+        tmp_one.shut();
+    this->built = false;
+    this->heaps.clear();
+    std::vector<char>().swap(this->rows);
+    delete [] in_col_type;
+    return tmp;
+}
+
 //----------------GroupBy-----------------
 
 GroupBy::GroupBy(Operator *Op, int groupby_num, RequestColumn req_col[4]){
@@ -639,6 +1886,9 @@ GroupBy::GroupBy(Operator *Op, int groupby_num, RequestColumn req_col[4]){
     this->rpattern = this->get_prior_rpattern();
     this->row_size = this->get_rpattern().getRowSize();
     this->col_num = this->table_out->getColumns().size();
+    this->in_col_type = new BasicType *[this->col_num];
+    for(int i = 0; i < this->col_num; i++)
+        this->in_col_type[i] = this->rpattern.getColumnType(i);
     this->req_col_ptr = req_col;
     for(int i = 0; i < groupby_num; i++){
         if(req_col[i].aggrerate_method == NONE_AM){
@@ -648,111 +1898,413 @@ GroupBy::GroupBy(Operator *Op, int groupby_num, RequestColumn req_col[4]){
             this->init_aggre(i);
         }
     }
+    // number of groups, product of distinct values of group columns
+    int64_t in_rows = Op->getEstimatedRows() > 0 ? Op->getEstimatedRows() : 1;
+    this->estimated_rows = 1;
+    for(int i = 0; i < groupby_num; i++){
+        Object *col = g_catalog.getObjByName(req_col[i].name);
+        if(req_col[i].aggrerate_method == NONE_AM && col != NULL)
+            this->estimated_rows = min(in_rows, this->estimated_rows * estimate_distinct(col->getOid(), in_rows));
+    }
+
+    // results of COUNT, SUM and AVG are wider than their columns
+    string cname = "tmp_groupby_table" + to_string(groupby_tabout_id);
+    auto &in_cols = this->table_in[0]->getColumns();
+    table_out = new RowTable(groupby_tabout_id++, constchar2char(cname.c_str()));
+    table_out->init();
+    RPattern *new_RPattern = &this->table_out->getRPattern();
+    new_RPattern->init(this->col_num);
+    BasicType *out_type[4];
+    for(int i = 0; i < this->col_num; i++)
+        out_type[i] = this->rpattern.getColumnType(i);
+    for(int k = 0; k < aggrerate_num; k++)
+        out_type[aggrerate_off[k]] = this->aggrerate_ops[k].out_type;
+    for(int i = 0; i < this->col_num; i++){
+        new_RPattern->addColumn(out_type[i]);
+        table_out->addColumn(in_cols[i]);
+        this->out_offset.push_back(this->out_length);
+        this->out_length += out_type[i]->getTypeSize();
+    }
 }
 
 bool GroupBy::init(){
     if(!prior_op->init())
         return false;
-    //------Result Tables------
-    RPattern in_RP = table_in[0]->getRPattern();
-    int in_colnum = table_in[0]->getColumns().size();
-    BasicType   **in_col_type;
-    in_col_type = new BasicType *[in_colnum];
-    for(int i=0; i < in_colnum; i++){
-        in_col_type[i] = in_RP.getColumnType(i);        
-    }
-    this->tmp_result.init(in_col_type, in_colnum,524288);
-    this->tmp_one.init(in_col_type, in_colnum);    
+    if (this->built)
+        tmp_one.shut();
+    this->built = true;
+    this->index = 0;
+    this->tmp_one.init(this->in_col_type, this->col_num);
+    this->drop_spilled();
     //------hash table------
-    HashTable *hstable = new HashTable(1000000, 4, 0); 
-    int64_t hash_count = 0;
-
-    char **probe_result = (char**)malloc(4 * round2(row_size));
-    char *src;
-    int64_t tmp_offset = 0;
-    int64_t pattern_count[32768];
-    int64_t key;
-    char tmp_buffer[1024];
-
-    for(int i = 0; i < 32768; i++)
-        pattern_count[i] = 0;
-    while( !prior_op->is_End()&&prior_op->get_Next(&tmp_one)){
-        //------generate the hash key------
-        key = 0;
-        tmp_offset = 0;
-        for(int i = 0; i < non_aggrerate_num; i++){
-            src = tmp_one.get_RC(0, non_aggrerate_off[i]);
-            tmp_one.column_type[non_aggrerate_off[i]]->formatTxt(tmp_buffer+tmp_offset, src);
-            tmp_offset += non_aggrerate_type[i]->getTypeSize();
-        }
-        key = gethash(tmp_buffer, NULL);   
-        //-----look up in hashtable-----
-        if(hstable->probe(key, probe_result, 4) > 0){
-            pattern_count[(uint64_t)probe_result[0]]++;
-            for(int i = 0; i < aggrerate_num; i++){
-                aggrerate(aggrerate_method[i], (uint64_t)probe_result[0], i);
+    // an entry is a row holding aggregate states, followed by the row count of its group
+    std::vector<AggKey> &keys = this->group_keys;
+    keys.clear();
+    for(int i = 0; i < non_aggrerate_num; i++)
+        keys.push_back({tmp_one.offset[non_aggrerate_off[i]], non_aggrerate_ops[i]});
+    int64_t row_length = tmp_one.row_length;
+    this->entry_size = row_length + sizeof(int64_t);
+    for(int k = 0; k < aggrerate_num; k++){
+        this->aggrerate_state[k] = this->entry_size;
+        this->entry_size += this->aggrerate_ops[k].state_size;
+    }
+    int64_t thread_max = std::thread::hardware_concurrency();
+    if (thread_max < 1)
+        thread_max = 1;
+    this->partials.resize(thread_max);
+    for (int64_t t = 0; t < thread_max; t++)
+        this->partials[t].init(entry_size, keys, min(this->estimated_rows, (int64_t)AGG_CHUNK_ROWS));
+
+    //------phase one, each thread folds a range of every chunk into its own groups------
+    // partial groups beyond the memory budget are spilled to hash partitions on disk
+    int64_t budget_groups = spill_budget() / (entry_size + 3 * sizeof(int64_t));
+    std::vector<SpillFile *> parts;
+    std::vector<char> chunk(AGG_CHUNK_ROWS * row_length);
+    int64_t row_num = AGG_CHUNK_ROWS;
+    this->directs.clear();
+    for (bool first = true; row_num == AGG_CHUNK_ROWS; first = false) {
+        row_num = 0;
+        while (row_num < AGG_CHUNK_ROWS && !prior_op->is_End() && prior_op->get_Next(&tmp_one))
+            memcpy(&chunk[row_num++ * row_length], tmp_one.buffer, row_length);
+        if (first && init_direct(chunk.data(), row_num))
+            this->directs.assign(thread_max, std::vector<char>(direct_groups * entry_size, 0));
+        int64_t thread_num = min(thread_max, row_num / AGG_THREAD_ROWS);
+        if (thread_num < 1)
+            thread_num = 1;
+        std::vector<std::thread> threads;
+        for (int64_t t = 1; t < thread_num; t++) {
+            int64_t begin = row_num * t / thread_num, end = row_num * (t + 1) / thread_num;
+            threads.push_back(std::thread(&GroupBy::aggrerate_rows, this, t, &chunk[begin * row_length], end - begin));
+        }
+        aggrerate_rows(0, chunk.data(), row_num / thread_num);
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        int64_t partial_groups = 0;
+        for (int64_t t = 0; t < thread_max; t++)
+            partial_groups += this->partials[t].getGroupNum();
+        if (partial_groups > budget_groups && !spill_partials(parts))
+            return false;
+    }
+
+    //------direct arrays are few entries, they are merged by this thread------
+    for (size_t t = 1; t < this->directs.size(); t++) {
+        for (int64_t g = 0; g < direct_groups; g++) {
+            char *entry = &this->directs[0][g * entry_size];
+            const char *src = &this->directs[t][g * entry_size];
+            int64_t src_count = load_value<int64_t>(src + row_length);
+            if (src_count == 0)
+                continue;
+            int64_t group_count = load_value<int64_t>(entry + row_length);
+            if (group_count == 0) {
+                memcpy(entry, src, entry_size);
+                continue;
             }
+            for (int k = 0; k < aggrerate_num; k++) {
+                if (this->aggrerate_ops[k].merge != NULL)
+                    this->aggrerate_ops[k].merge(entry + aggrerate_state[k], src + aggrerate_state[k], this->aggrerate_ops[k].size);
+            }
+            group_count += src_count;
+            memcpy(entry + row_length, &group_count, sizeof(int64_t));
         }
-        else{
-            hstable->add(key, (char*)hash_count);
-            for(int j = 0; j < col_num; j++){
-                src = tmp_one.get_RC(0, j);
-                tmp_result.write_RC(hash_count, j, src);             
+    }
+
+    if (!parts.empty()) {
+        // groups are merged a partition at a time as get_Next reads them
+        if (!spill_partials(parts))
+            return false;
+        for (size_t p = 0; p < parts.size(); p++) {
+            if (parts[p]->getRowNum() > 0)
+                this->spilled.push_back(std::make_pair(parts[p], (int64_t)0));
+            else
+                delete parts[p];
+        }
+    }
+
+    //------phase two, partial groups are merged by hash partition------
+    int64_t used = 0, total = 0, last = 0;
+    for (int64_t t = 0; t < thread_max; t++) {
+        if (this->partials[t].getGroupNum() > 0) {
+            used++;
+            last = t;
+        }
+        total += this->partials[t].getGroupNum();
+    }
+    if (used <= 1) {
+        // one thread has all groups out of direct arrays, not always thread 0, its groups are final
+        this->groups.resize(1);
+        std::swap(this->groups[0], this->partials[last]);
+    }
+    else {
+        // few groups are merged by this thread alone
+        int64_t part_num = min(thread_max, total / AGG_THREAD_GROUPS);
+        if (part_num < 1)
+            part_num = 1;
+        this->groups.resize(part_num);
+        for (int64_t p = 0; p < part_num; p++)
+            this->groups[p].init(entry_size, keys, total / part_num);
+        std::vector<std::thread> threads;
+        for (int64_t p = 1; p < part_num; p++)
+            threads.push_back(std::thread(&GroupBy::merge_partition, this, &this->groups[p], p, part_num));
+        merge_partition(&this->groups[0], 0, part_num);
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+    }
+    for (size_t t = 0; t < this->partials.size(); t++)
+        this->partials[t].clear();
+    this->directs.resize(min((size_t)1, this->directs.size()));
+    this->outputs.clear();
+    for (int64_t g = 0; g < (int64_t)this->directs.size() * direct_groups; g++) {
+        if (load_value<int64_t>(&this->directs[0][g * entry_size] + row_length) > 0)
+            this->outputs.push_back(&this->directs[0][g * entry_size]);
+    }
+    for (size_t p = 0; p < this->groups.size(); p++) {
+        for (int64_t r = 0; r < this->groups[p].getGroupNum(); r++)
+            this->outputs.push_back(this->groups[p].getEntry(r));
+    }
+    return true;
+}
+
+uint64_t GroupBy::group_hash(const char *row){
+    uint64_t hash = 0;
+    for(int i = 0; i < non_aggrerate_num; i++){
+        const char *src = row + tmp_one.offset[non_aggrerate_off[i]];
+        hash = hash_combine(hash, non_aggrerate_ops[i].hash(src, non_aggrerate_ops[i].size));
+    }
+    return hash;
+}
+
+/** integer value of a group column, for the direct array of groups. */
+template <typename T>
+static int64_t load_key(const char *p) {
+    return load_value<T>(p);
+}
+
+/**
+ * loader of a group column of integer type, keys of other types are only hashed
+ */
+static int64_t (*key_loader(BasicType *type))(const char *) {
+    switch (type->getTypeCode()) {
+        case INT8_TC:     return load_key<int8_t>;
+        case INT16_TC:    return load_key<int16_t>;
+        case CHARDICT_TC: return load_key<int16_t>;
+        case INT32_TC:    return load_key<int32_t>;
+        case INT64_TC:    return load_key<int64_t>;
+        default:          return NULL;
+    }
+}
+
+bool GroupBy::init_direct(const char *rows, int64_t row_num){
+    this->direct_groups = 0;
+    int64_t groups = 1;
+    for(int i = 0; i < non_aggrerate_num; i++){
+        direct_load[i] = key_loader(non_aggrerate_type[i]);
+        if (direct_load[i] == NULL)
+            return false;
+        // statistics bound keys of the whole input, the first chunk bounds only itself and
+        // later keys out of its range fall back to the hash table, as do keys of stale statistics
+        int64_t size = non_aggrerate_type[i]->getTypeSize();
+        ColumnStats *stats = non_aggrerate_oid[i] >= 0 ? g_catalog.getColumnStats(non_aggrerate_oid[i]) : NULL;
+        int64_t lo, hi;
+        if (stats != NULL && (int64_t)stats->min.size() >= size && (int64_t)stats->max.size() >= size) {
+            lo = direct_load[i](stats->min.data());
+            hi = direct_load[i](stats->max.data());
+        }
+        else {
+            if (row_num == 0)
+                return false;
+            int64_t offset = tmp_one.offset[non_aggrerate_off[i]];
+            lo = hi = direct_load[i](rows + offset);
+            for (int64_t r = 1; r < row_num; r++) {
+                int64_t key = direct_load[i](rows + r * tmp_one.row_length + offset);
+                lo = min(lo, key);
+                hi = max(hi, key);
             }
-            tmp_result.row_number++;   
-            pattern_count[hash_count]++;
-            hash_count++;
         }
+        if (hi < lo || hi - lo >= AGG_DIRECT_GROUPS)
+            return false;
+        direct_min[i] = lo;
+        direct_span[i] = hi - lo + 1;
+        groups *= direct_span[i];
+        if (groups > AGG_DIRECT_GROUPS)
+            return false;
+    }
+    // the last group column varies fastest
+    int64_t stride = 1;
+    for(int i = non_aggrerate_num - 1; i >= 0; i--){
+        direct_stride[i] = stride;
+        stride *= direct_span[i];
     }
-    this->pattern_count_ptr = pattern_count;
-    this->aggrerate_method_handler(hash_count);
-    free(probe_result);
+    this->direct_groups = groups;
     return true;
 }
 
+void GroupBy::aggrerate_rows(int64_t thread, const char *rows, int64_t row_num){
+    AggTable *table = &this->partials[thread];
+    char *direct = this->directs.empty() ? NULL : this->directs[thread].data();
+    int64_t row_length = tmp_one.row_length;
+    bool inserted;
+    // rows of existing groups are collected and folded by the update kernels a batch at a time
+    char *batch_entries[AGG_UPDATE_ROWS];
+    const char *batch_rows[AGG_UPDATE_ROWS];
+    int64_t batch_num = 0;
+    for (int64_t r = 0; r < row_num; r++) {
+        const char *row = rows + r * row_length;
+        int64_t rank = direct != NULL ? direct_rank(row) : -1;
+        char *entry;
+        if (rank >= 0) {
+            entry = direct + rank * entry_size;
+            inserted = load_value<int64_t>(entry + row_length) == 0;
+        }
+        else
+            entry = table->findOrInsert(group_hash(row), row, inserted);
+        int64_t group_count = 1;
+        if (inserted) {
+            memcpy(entry, row, row_length);
+            for (int k = 0; k < aggrerate_num; k++) {
+                if (this->aggrerate_ops[k].start != NULL)
+                    this->aggrerate_ops[k].start(entry + aggrerate_state[k], row + tmp_one.offset[aggrerate_off[k]], this->aggrerate_ops[k].size);
+            }
+        }
+        else {
+            group_count += load_value<int64_t>(entry + row_length);
+            batch_entries[batch_num] = entry;
+            batch_rows[batch_num++] = row;
+            if (batch_num == AGG_UPDATE_ROWS) {
+                aggrerate(batch_entries, batch_rows, batch_num);
+                batch_num = 0;
+            }
+        }
+        memcpy(entry + row_length, &group_count, sizeof(int64_t));
+    }
+    aggrerate(batch_entries, batch_rows, batch_num);
+}
 
-bool GroupBy::get_Next(ResultTable *result){
-    if(this->index >= tmp_result.row_number)
+void GroupBy::merge_partition(AggTable *table, int64_t part, int64_t part_num){
+    for (size_t t = 0; t < this->partials.size(); t++) {
+        AggTable &partial = this->partials[t];
+        for (int64_t r = 0; r < partial.getGroupNum(); r++) {
+            // high bits choose the partition, low bits the slot
+            uint64_t hash = partial.getHash(r);
+            if ((int64_t)((hash >> 40) % part_num) == part)
+                merge_entry(table, hash, partial.getEntry(r));
+        }
+    }
+}
+
+void GroupBy::merge_entry(AggTable *table, uint64_t hash, const char *src){
+    int64_t row_length = tmp_one.row_length;
+    bool inserted;
+    char *entry = table->findOrInsert(hash, src, inserted);
+    if (inserted) {
+        memcpy(entry, src, entry_size);
+        return;
+    }
+    for (int k = 0; k < aggrerate_num; k++) {
+        if (this->aggrerate_ops[k].merge != NULL)
+            this->aggrerate_ops[k].merge(entry + aggrerate_state[k], src + aggrerate_state[k], this->aggrerate_ops[k].size);
+    }
+    int64_t group_count = load_value<int64_t>(entry + row_length) + load_value<int64_t>(src + row_length);
+    memcpy(entry + row_length, &group_count, sizeof(int64_t));
+}
+
+bool GroupBy::spill_partials(std::vector<SpillFile *> &parts){
+    for (int64_t p = parts.size(); p < SPILL_PARTITIONS; p++) {
+        parts.push_back(new SpillFile());
+        if (!parts[p]->open(entry_size))
+            return false;
+    }
+    for (size_t t = 0; t < this->partials.size(); t++) {
+        AggTable &partial = this->partials[t];
+        for (int64_t r = 0; r < partial.getGroupNum(); r++) {
+            if (!parts[spill_partition(partial.getHash(r), 0)]->append(partial.getEntry(r)))
+                return false;
+        }
+        partial.init(entry_size, group_keys, partial.getGroupNum());
+    }
+    return true;
+}
+
+bool GroupBy::next_partition(){
+    if (this->spilled.empty())
+        return false;
+    SpillFile *file = this->spilled.back().first;
+    int64_t depth = this->spilled.back().second;
+    this->spilled.pop_back();
+    this->outputs.clear();
+    this->index = 0;
+    if (!file->rewind()) {
+        delete file;
         return false;
-    for(int j = 0; j < col_num; j++){
-        char* buf = tmp_result.get_RC(this->index, j);
-        if(!result->write_RC(0, j, buf)) return false;
     }
+    if (file->getRowNum() * (entry_size + 3 * (int64_t)sizeof(int64_t)) > spill_budget() && depth + 1 < SPILL_MAX_DEPTH) {
+        // too many entries for memory, they are split by further bits of their hash
+        std::vector<SpillFile *> parts;
+        for (int64_t p = 0; p < SPILL_PARTITIONS; p++) {
+            parts.push_back(new SpillFile());
+            this->spilled.push_back(std::make_pair(parts[p], depth + 1));
+            if (!parts[p]->open(entry_size)) {
+                delete file;
+                return false;
+            }
+        }
+        for (const char *src = file->next(); src != NULL; src = file->next()) {
+            if (!parts[spill_partition(group_hash(src), depth + 1)]->append(src)) {
+                delete file;
+                return false;
+            }
+        }
+        delete file;
+        // empty partitions are dropped, each one left holds a group
+        for (int64_t p = this->spilled.size() - 1; p >= 0; p--) {
+            if (this->spilled[p].first->getRowNum() == 0) {
+                delete this->spilled[p].first;
+                this->spilled.erase(this->spilled.begin() + p);
+            }
+        }
+        return true;
+    }
+    this->groups.resize(1);
+    this->groups[0].init(entry_size, group_keys, file->getRowNum());
+    for (const char *src = file->next(); src != NULL; src = file->next())
+        merge_entry(&this->groups[0], group_hash(src), src);
+    delete file;
+    for (int64_t r = 0; r < this->groups[0].getGroupNum(); r++)
+        this->outputs.push_back(this->groups[0].getEntry(r));
+    return true;
+}
+
+bool GroupBy::get_Next(ResultTable *result){
+    while (this->index >= this->outputs.size()) {
+        if (!this->next_partition())
+            return false;
+    }
+    this->aggrerate_method_handler(this->outputs[this->index], result->get_RC(0, 0));
     index++;
     return true;
 }
 
 bool GroupBy::is_End(){
-    return prior_op->is_End();
+    return this->index >= this->outputs.size() && this->spilled.empty();
 }
 
 bool GroupBy::close() {
     bool tmp = prior_op->close();
     delete prior_op;
-    tmp_one.shut();
-    tmp_result.shut();
+    if (this->built)
+        tmp_one.shut();
+    this->built = false;
+    this->groups.clear();
+    this->partials.clear();
+    this->directs.clear();
+    this->outputs.clear();
+    this->drop_spilled();
+    delete [] in_col_type;
     return tmp;
 }
 
-bool GroupBy::aggrerate(AggrerateMethod method, uint64_t probe_result, int agg_i){
-    this->agg_i = agg_i;
-    char* datain = tmp_one.get_RC(0, aggrerate_off[this->agg_i]);
-    char* dataout = tmp_result.get_RC(probe_result, aggrerate_off[this->agg_i]);
-    this->datain = datain;
-    this->dataout = dataout;
-    switch(method){
-    case SUM:
-        this->sum_handler();
-    case AVG:{
-        return this->avg_handler();
-    }
-    case MAX:
-        this->max_handler();
-        break;
-    case MIN:
-        this->min_handler();
-        break;
-    default:
-        break;
+void GroupBy::aggrerate(char *const *entries, const char *const *rows, int64_t row_num){
+    for (int k = 0; k < aggrerate_num && row_num > 0; k++) {
+        if (this->aggrerate_ops[k].update != NULL)
+            this->aggrerate_ops[k].update(entries, aggrerate_state[k], rows, tmp_one.offset[aggrerate_off[k]], row_num, this->aggrerate_ops[k].size);
     }
 }
@@ -15,8 +15,38 @@
 
 #include "catalog.h"
 #include "mymemory.h"
+#include "simd.h"
+#include "typeops.h"
+#include "codegen.h"
+#include "aggtable.h"
+#include "sorter.h"
+#include "spill.h"
+#include <thread>
 
 uint32_t gethash(char *key, BasicType * type);
+int64_t row_buffer_size(int64_t row_length);
+int64_t rowid_oid(int64_t table_oid);
+bool link_equal(BasicType *type_a, char *value_a, BasicType *type_b, char *value_b);
+
+#define HASHJOIN_PROBE_CAPACITY (64)    /**< hash entries fetched by one probe of HashJoin */
+#define SCAN_BATCH_SIZE         (ZONE_ROWS) /**< records filtered together by Scan, one zone map block */
+#define COMPILE_MIN_ROWS        (1L << 16) /**< Scan of a table this large runs a compiled pipeline */
+#define PLAN_CACHE_SIZE         (256)   /**< operator trees kept by Executor for reuse        */
+#define AGG_CHUNK_ROWS          (1L << 16) /**< input rows GroupBy buffers before aggregating them */
+#define AGG_THREAD_ROWS         (1L << 13) /**< minimum rows of a chunk aggregated by one GroupBy thread */
+#define AGG_THREAD_GROUPS       (1L << 14) /**< minimum partial groups merged by one GroupBy thread */
+#define AGG_DIRECT_GROUPS       (1L << 12) /**< largest key domain GroupBy aggregates in a direct array */
+#define AGG_STATE_SIZE          (16)    /**< size of the accumulator of SUM and AVG            */
+#define SORT_CHUNK_ROWS         (1L << 16) /**< input rows TopN buffers before ranking them */
+#define SORT_THREAD_ROWS        (1L << 13) /**< minimum rows of a chunk ranked by one TopN thread */
+#define SORT_RUN_ROWS           (1L << 16) /**< rows of a run OrderBy sorts on one thread */
+#define SORT_SAMPLE_KEYS        (64)    /**< keys sampled from each run to choose merge splitters */
+#define AGG_UPDATE_ROWS         (256)   /**< rows folded by one call of an update kernel       */
+#define RESULT_BLOCK_SIZE       (1L << 16) /**< bytes of a block of rows in ResultTable returned by Executor */
+#define RESULT_THREAD_ROWS      (1L << 13) /**< minimum rows of a batch formatted by one thread */
+#define EXEC_BATCH_ROWS         (1L << 16) /**< most rows Executor::exec returns at once */
+#define SELECTIVITY_EQ          (0.1)   /**< default selectivity of an equality predicate     */
+#define SELECTIVITY_RANGE       (1.0/3) /**< default selectivity of a range predicate         */
 
 /** aggrerate method. */
 enum AggrerateMethod {
@@ -29,6 +59,30 @@ enum AggrerateMethod {
     MAX_AM
 };
 
+/** definition of AggregateOps, typed kernels of an aggregate whose state is kept apart from the row. */
+struct AggregateOps {
+    BasicType *out_type = NULL;     /**< type of the result, int64 or double for COUNT, SUM and AVG */
+    int64_t size = 0;               /**< size of a value of the column          */
+    int64_t state_size = 0;         /**< size of the accumulator, 0 for COUNT   */
+    /** set the accumulator from the first value of its group */
+    void (*start)(char *acc, const char *value, int64_t size) = NULL;
+    /** fold a batch of rows into accumulators of their groups, at acc_offset in entries and value_offset in rows */
+    void (*update)(char *const *entries, int64_t acc_offset, const char *const *rows, int64_t value_offset, int64_t num, int64_t size) = NULL;
+    /** fold the accumulator of the same group built by another thread */
+    void (*merge)(char *acc, const char *other, int64_t size) = NULL;
+    /** write the result of a group of count rows */
+    void (*result)(const char *acc, int64_t count, char *out, int64_t size) = NULL;
+};
+
+/**
+ * get kernels of an aggregate
+ * integers are summed in int64, floats in double with Kahan compensation, AVG divides at the end
+ * @param method aggregate method
+ * @param type column type
+ * @retval kernels, result is NULL if the method does not apply to the type
+ */
+AggregateOps aggregate_ops(AggrerateMethod method, BasicType *type);
+
 /** compare method. */
 enum CompareMethod {
     NONE_CM = 0,
@@ -60,6 +114,22 @@ struct Condition {
     char value[128];        /**< the value to compare with, if compare==LINK,value is another column's name; else it's the column's value*/
 };
 
+/**
+ * estimate the fraction of records passing a filter condition
+ * MCVs and histogram of the column are used when statistics exist
+ * @param condi filter condition, compare against a constant
+ * @retval selectivity in (0, 1]
+ */
+double estimate_selectivity(Condition *condi);
+
+/**
+ * estimate distinct values of a column among some of its records
+ * @param col_oid column object id
+ * @param rows    estimated number of records
+ * @retval distinct values, at least 1 and at most rows
+ */
+int64_t estimate_distinct(int64_t col_oid, int64_t rows);
+
 /** definition of conditions. */
 struct Conditions {
     int condition_num;      /**< number of condition in use */
@@ -80,6 +150,7 @@ class SelectQuery {
     Conditions having;             /**< groupby conditions */
     int orderby_number;            /**< number of columns to orderby */
     RequestColumn orderby[4];      /**< columns to orderby */
+    int64_t limit;                 /**< maximum number of records to return, 0 for no limit */
 };  // class SelectQuery
 
 /** definition of result table.  */
@@ -94,6 +165,9 @@ class ResultTable {
     int row_capicity;     /**< maximum capicity of rows according to buffer size and length of row  MAXIMUN OF ROW */
     int *offset;
     int offset_size;
+    char **blocks;        /**< blocks of rows, blocks[0] is buffer, NULL until a second block is linked */
+    int64_t blocks_size;  /**< size of blocks array */
+    int block_number;     /**< blocks holding rows, each of buffer_size */
 
     /**
      * init alloc memory and set initial value
@@ -104,6 +178,13 @@ class ResultTable {
      * @retval <=0  failure
      */
     int init(BasicType *col_types[],int col_num,int64_t capicity = 1024);
+    /**
+     * get buffer of row row_number, a block of buffer_size is linked when the last one is full
+     * the caller writes the row, then counts it in row_number
+     * @retval !=NULL pointer of the row
+     * @retval ==NULL error
+     */
+    char* reserveRow(void);
     /**
      * calculate the char pointer of data spcified by row and column id
      * you should set up column_type,then call init function
@@ -131,6 +212,18 @@ class ResultTable {
      * write to file with FILE *fp
      */
     int dump(FILE *fp);
+    /**
+     * format all rows as print outputs them, large batches are formatted by several threads
+     * @param text buffer to store the text, replaced
+     * @retval length of the text
+     */
+    int64_t format(std::vector<char> &text);
+    /**
+     * format rows [begin, end), values with typed format, others by formatTxt
+     * @param ops  operations of each column
+     * @param text buffer to store the text, replaced
+     */
+    void formatRows(const std::vector<TypeOps> &ops, int begin, int end, std::vector<char> &text);
     /**
      * free memory of this result table to g_memory
      */
@@ -148,6 +241,7 @@ class Operator {
         int64_t table_out_col_num = 0;	/**< the number of column in table_out. */
         ResultTable result;             /**< each operator got its own ResultTable(Buffer) except Scan Operator. */
         BasicType   **in_col_type;    	/**< column types of input tables. */
+        int64_t estimated_rows = 0;     /**< estimated number of output records, used by the planner. */
 	public:
         int64_t Ope_id = 0;	        
         /**
@@ -155,7 +249,7 @@ class Operator {
          */
         Operator(void) {}
         /**
-         *  operator init
+         *  operator init, may be called again once the operator returned all records, it then reruns
          *  @retval false for failure 
          *  @retval true  for success 
          */
@@ -183,24 +277,130 @@ class Operator {
          * get the output result table of this Operator
          * @retval table_out 
          */
-        RowTable *getTableOut   () { 
-            return table_out; 
+        RowTable *getTableOut   () {
+            return table_out;
+        }
+        /**
+         * get the estimated number of records this Operator will output
+         * @retval estimated_rows
+         */
+        int64_t getEstimatedRows () {
+            return estimated_rows;
+        }
+        /**
+         * set the estimated number of records, used when the planner knows better than the Operator
+         * @param rows estimated number of output records
+         */
+        void setEstimatedRows (int64_t rows) {
+            estimated_rows = rows;
         }
 
 
 };
 
+/** definition of Predicate, a filter condition evaluated by Scan directly on records. */
+class Predicate {
+    public:
+        CompareMethod compare;          /**< compare method                             */
+        BasicType *type;                /**< type of the column                         */
+        int64_t column_rank;            /**< rank of the column in table pattern        */
+        int64_t offset;                 /**< offset of the column in record             */
+        std::string value;              /**< constant to compare with, binary format    */
+        SimdCompare simd_op;            /**< compare method of SIMD kernel              */
+        std::vector<char> column;       /**< column vector of a batch, input of kernel  */
+        std::vector<uint64_t> mask;     /**< bitmask of passed records, kernel output   */
+        double cost;                    /**< relative cost of one comparison            */
+        double selectivity;             /**< estimated selectivity, until rows are seen */
+        int64_t evaluated = 0;          /**< records evaluated                          */
+        int64_t passed = 0;             /**< records passed                             */
+        int param = -1;                 /**< rank of its condition in query, having conditions follow the 4 where conditions, see Scan::bind */
+        /**
+         * construction of Predicate
+         * @param table table of records
+         * @param condi filter condition, compare a column of table against a constant
+         */
+        Predicate(RowTable *table, Condition *condi);
+        /**
+         * set the constant to compare with, the buffer is reused so compiled pipelines keep pointing to it
+         * @param text constant in text format
+         */
+        void bind(const char *text);
+        /**
+         * keep records passing the predicate, in their order
+         * @param rows records to test, passing records are moved to the front
+         * @param row_num number of records
+         * @retval number of records passed
+         */
+        int64_t select(char **rows, int64_t row_num);
+        /**
+         * test zone map of a block, see RowTable::getZone
+         * @param table table of records
+         * @param block the n th block of ZONE_ROWS records
+         * @retval true  no record of the block can pass
+         * @retval false some records may pass
+         */
+        bool skipZone(RowTable *table, int64_t block);
+        /**
+         * test records of a full block on packed values, see RowTable::packedCompare
+         * @param table table of records
+         * @param block the n th block of ZONE_ROWS records
+         * @param block_mask bit i is cleared if record i of block fails
+         * @retval true  block tested
+         * @retval false the column is not packed in the block, use select on records
+         */
+        bool selectPacked(RowTable *table, int64_t block, uint64_t *block_mask);
+        /**
+         * rank of predicate, conjuncts are evaluated in ascending rank
+         * cheap predicates dropping many records come first
+         */
+        double rank() const {
+            double pass = evaluated > 0 ? (double)passed / evaluated : selectivity;
+            return cost / (1.0 - pass + 1e-6);
+        }
+};
+
 /** definition of Scan operator. */
 class Scan : public Operator {
     private:
         int64_t current_row;/**< row number has been scaned. */
         int64_t col_num;    /**< number of columns           */
+        std::vector<int64_t> col_offset; /**< offset in record of each output column, -1 for row id */
+        std::vector<Predicate> predicates; /**< conjunctive filter conditions, in evaluation order */
+        std::vector<char *> batch;  /**< records of current batch passing all predicates */
+        int64_t batch_num = 0;      /**< number of records in batch                 */
+        int64_t batch_pos = 0;      /**< next record of batch to output             */
+        std::vector<uint64_t> block_mask;   /**< records of block passing packed predicates */
+        std::vector<char> tested;           /**< whether each predicate was tested on packed values */
+        PipelineFunc pipeline = NULL;       /**< compiled filter and projection, NULL if interpreted */
+        std::vector<const char *> constants;/**< constants of predicates, arguments of pipeline */
+        std::vector<char> compiled_rows;    /**< output rows of pipeline for current batch      */
+        int64_t compiled_length = 0;        /**< length of an output row of pipeline            */
 	public:
         /**
          * Scan rowtable from table_in
          * @param tablename the table_in that this function will scan 
          */
         Scan(char *tablename);
+        /**
+         * Scan some columns of rowtable from table_in
+         * @param tablename the table_in that this function will scan 
+         * @param col_tot number of columns to output
+         * @param col_oids object ids of columns to output
+         * @param with_rowid output the record pointer as a last INT64 column, see rowid_oid
+         */
+        Scan(char *tablename, int64_t col_tot, int64_t *col_oids, bool with_rowid);
+        /**
+         * add a filter condition, all conditions of a Scan are and-ed
+         * the column need not be in the output of Scan
+         * @param condi filter condition, compare a column against a constant
+         * @param param rank of the condition in query, see Predicate::param, -1 if never rebound
+         */
+        void    addPredicate (Condition *condi, int param = -1);
+        /**
+         * rebind constants of predicates to those of a query of the same shape
+         * @param query query whose conditions are at the ranks given to addPredicate
+         */
+        void    bind (SelectQuery *query);
         /**
          * init scan operator 
          * @retval false for failure 
@@ -227,31 +427,31 @@ class Scan : public Operator {
          */
         bool    close   ();
         /**
-         * write a row in resulttable
+         * read next batch of valid records and filter them
+         * @retval false no more records
+         * @retval true  a batch is read, it may be empty
+         */
+        bool    nextBatch ();
+        /**
+         * compile predicates and output columns into a native pipeline, see compile_pipeline
+         * @retval false not compiled, batches are interpreted
+         * @retval true  batches run the compiled pipeline
+         */
+        bool    compile ();
+        /**
+         * write a row in resulttable, columns are copied straight from the record
          * @retval false for failure 
          * @retval true  for success 
          */
-        bool    writeRow (char* buffer, ResultTable *result){
+        bool    writeRow (char *row, ResultTable *result){
             for (int current_col = 0; current_col < col_num; current_col++) {
-                if (!this->table_in[0]->selectCol(current_row, current_col, buffer)) {
-                    g_memory.free(buffer, 128);
-                    return false;
-                }
-                if (!result->write_RC(0, current_col, buffer)) {
-                    g_memory.free(buffer, 128);
+                char *data = col_offset[current_col] < 0 ? (char *)&row : row + col_offset[current_col];
+                if (!result->write_RC(0, current_col, data))
                     return false;
-                }
             }
             return true;
         } 
 
-        bool    equalornot(){
-            if(this->current_row == this->table_in[0]->getRecordNum()){
-                return true;
-            }else{
-                return false;
-            }
-        }
 };
 
 /** definition of filter operaotr*/
@@ -262,6 +462,9 @@ class Filter : public Operator {
         char value[128];                /**< const value                      */ 
         BasicType *value_type;          /**< column types of filter columns   */
         CompareMethod compare_method;   /**< compare methods                  */
+        int64_t link_rank = -1;         /**< rank of the other column if LINK */
+        BasicType *link_type = NULL;    /**< type of the other column if LINK */
+        TypeOps value_ops;              /**< typed compare, none if compared as text */
     public:
         /**
          * construction of filter Operator
@@ -305,7 +508,7 @@ class Filter : public Operator {
             in_col_type = new BasicType *[in_colnum];
             for(int i=0; i < in_colnum; i++)
                 in_col_type[i] = in_RP.getColumnType(i);
-            this->result.init(in_col_type, in_colnum);
+            this->result.init(in_col_type, in_colnum, row_buffer_size(in_RP.getRowSize()));
         }
         /**
          * check the result of cmp
@@ -313,19 +516,19 @@ class Filter : public Operator {
          * @retval true  for success 
          */
         bool    compare_exec (char* cmpSrcA_ptr, char* cmpSrcB_ptr){
-            if (this->compare_method == LT)
-                return this->value_type->cmpLT(cmpSrcA_ptr, cmpSrcB_ptr);
-            else if (this->compare_method == LE)
-                return this->value_type->cmpLE(cmpSrcA_ptr, cmpSrcB_ptr);
-            else if (this->compare_method == EQ)
-                return this->value_type->cmpEQ(cmpSrcA_ptr, cmpSrcB_ptr);
-            else if (this->compare_method == NE)
-                return !this->value_type->cmpEQ(cmpSrcA_ptr, cmpSrcB_ptr);
-            else if (this->compare_method == GT)
-                return this->value_type->cmpGT(cmpSrcA_ptr, cmpSrcB_ptr);
-            else if (this->compare_method == GE)
-                return this->value_type->cmpGE(cmpSrcA_ptr, cmpSrcB_ptr);
-            else return false;            
+            if (this->value_ops.compare == NULL)
+                return this->compare_method == LINK && link_equal(this->value_type, cmpSrcA_ptr, this->link_type, cmpSrcB_ptr);
+            int c = this->value_ops.compare(cmpSrcA_ptr, cmpSrcB_ptr, this->value_ops.size);
+            switch (this->compare_method) {
+                case LT: return c < 0;
+                case LE: return c <= 0;
+                case EQ:
+                case LINK: return c == 0;
+                case NE: return c != 0;
+                case GT: return c > 0;
+                case GE: return c >= 0;
+                default: return false;
+            }
         }
         /**
          * copy result
@@ -357,6 +560,13 @@ class Filter : public Operator {
 }; 
 
 /** definition of hashjoin. */
+/** definition of SpilledJoin, a partition of both inputs of HashJoin spilled to disk. */
+struct SpilledJoin {
+    SpillFile *build;   /**< rows of table B        */
+    SpillFile *probe;   /**< rows of table A        */
+    int64_t depth;      /**< times the partition was split */
+};
+
 class HashJoin : public Operator {
     private:
         Operator *Op[2] = {NULL, NULL};    /**< prior operator from tow join table. */
@@ -368,11 +578,49 @@ class HashJoin : public Operator {
         int64_t col_B_oid = -1;            /**< column B object  id                 */
         int64_t col_A_rank = -1;           /**< column A rank                       */
         int64_t col_B_rank = -1;           /**< column B rank                       */
-        ResultTable row_i[200000];         /**< result table to store temp result   */
+        ResultTable build_row;             /**< buffer to receive one row of table B */
+        MStorage build_rows;               /**< compact storage of all rows of table B */
+        std::vector<char *> match_rows;    /**< rows of table B matching current probe row */
+        size_t match_pos = 0;              /**< next row in match_rows to output    */
         BasicType * value_type;            /**< result type of result               */
         HashIndex * hash_index = NULL;     /**< hash index of hash table            */
         HashTable * hash_table = NULL;     /**< hash tale to store data             */
         BasicType** col_B_type;            /**< column types of table B             */
+        TypeOps key_ops;                   /**< typed hash and compare of join key, none if keys compare as text */
+        int64_t depth = 0;                 /**< times the partition being joined was split, 0 for whole inputs */
+        int64_t part_rows[SPILL_PARTITIONS]; /**< rows of table B of each partition kept in memory */
+        std::vector<SpillFile *> build_parts; /**< rows of table B of each partition spilled, NULL if kept, empty if none spilled */
+        std::vector<SpillFile *> probe_parts; /**< rows of table A of each partition spilled */
+        std::vector<SpilledJoin> pending;  /**< spilled partitions waiting to be joined */
+        SpillFile *probe_file = NULL;      /**< rows of table A of the partition being joined, NULL while reading table A */
+        /**
+         * release the hash table and rows of table B built by init
+         */
+        void    releaseBuild ();
+        /**
+         * build the hash table, partitions beyond the memory budget are spilled
+         * @param source rows of table B, NULL to read them from prior operator
+         * @param depth times the partition being built was split
+         * @param expected_rows estimated rows of table B
+         * @retval false for failure
+         */
+        bool    build (SpillFile *source, int64_t depth, int64_t expected_rows);
+        /**
+         * spill rows of a partition read from now on
+         * @param p partition
+         * @retval false for failure
+         */
+        bool    spillPart (int64_t p);
+        /**
+         * read next row of table A into result, join spilled partitions when the input ends
+         * @retval false if all rows are read
+         */
+        bool    nextProbe ();
+        /**
+         * queue spilled partitions, then build the next one waiting
+         * @retval false if none is left
+         */
+        bool    nextPartition ();
     public:
         /**
          * construction of HashJoin
@@ -408,13 +656,13 @@ class HashJoin : public Operator {
          */
         bool    close   (); 
         /**
-         * first deal with the data
+         * first deal with the data, the input with less estimated records becomes table B (build side)
          * @retval false for failure 
          * @retval true  for success 
          */
         void    Fdeal   (int operator_num, Operator **Op){
             this->operator_num = operator_num;
-            if (Op[1]->getTableOut()->getRecordNum()>Op[0]->getTableOut()->getRecordNum()) {
+            if (Op[1]->getEstimatedRows() > Op[0]->getEstimatedRows()) {
                 Operator* op_switch = Op[1];
                 Op[1] = Op[0];
                 Op[0] = op_switch;
@@ -448,68 +696,39 @@ class HashJoin : public Operator {
             col_B_rank = table_in[1]->getColumnRank(col_B_oid);            
         }
         /**
-         * allocate value
-         * @retval false for failure 
-         * @retval true  for success 
+         * find all rows of table B whose join column equals the current probe row
+         * @param key join column value of the probe row
+         * @retval number of rows matched
          */
-        void    alloValue  (char * value, char * format_value){
-            while (!Op[1]->is_End()) {
-                row_i[col_B_row].init(col_B_type, col_num[1]);
-                Op[1]->get_Next(&row_i[col_B_row]);
-                
-                value = row_i[col_B_row].get_RC(0, col_B_rank);
-                BasicType * this_type = table_in[1]->getRPattern().getColumnType(col_B_rank);
-
-                this_type->formatTxt(format_value, value);
-                uint32_t hash_value = gethash(format_value, this_type);
-                hash_table->add(hash_value, (char *)&row_i[col_B_row]);
-                
-                col_B_row++ ;
-            }
-            this->value_type = table_in[0]->getRPattern().getColumnType(col_A_rank);
-        }
+        size_t  probeMatch (char *key);
         /**
-         * write row
-         * @retval false for failure 
-         * @retval true  for success 
+         * hash a join key of either table
+         * @param type type of the key column
+         * @param key  value of the key
+         * @retval hash code, never negative
          */
-        bool    WriteRow  (bool flag, ResultTable *result){
-            if (flag) {
-                char* buffer;
-                for (int j = 0; j < col_num[0]; j++) {
-                    buffer = this->result.get_RC(0L, j);
-                    if (!result->write_RC(0, j, buffer))
-                    {
-                        return false;
-                    } 
-                }
-                for (int j = 0; j < col_num[1]; j++) {
-                    buffer = row_i->get_RC(0L, j);
-                    if (!result->write_RC(0, col_num[0] + j, buffer))
-                    {
-                        return false;
-                    } 
-                }
-            }
-            return true;
-        }
+        int64_t keyHash (BasicType *type, char *key);
         /**
-         * shut memory
+         * write probe row and a matched row of table B
          * @retval false for failure 
          * @retval true  for success 
          */
-        bool    ShutMem   (){
-            delete hash_table;
-            result.shut();
-            delete []in_col_type;
-            for (int i = 0; i < col_B_row; i++) {
-                row_i[i].shut();
+        bool    WriteRow  (char *row_b, ResultTable *result){
+            char* buffer;
+            for (int j = 0; j < col_num[0]; j++) {
+                buffer = this->result.get_RC(0L, j);
+                if (!result->write_RC(0, j, buffer))
+                {
+                    return false;
+                } 
+            }
+            for (int j = 0; j < col_num[1]; j++) {
+                buffer = row_b + build_row.offset[j];
+                if (!result->write_RC(0, col_num[0] + j, buffer))
+                {
+                    return false;
+                } 
             }
-            for (int i = 0; i < operator_num; i++) 
-                if (!Op[i]->close()) return false;
-            for (int i = 0; i < operator_num; i++) 
-                delete Op[i];
-            delete [] col_B_type;
             return true;
         }
 };
@@ -520,6 +739,9 @@ class Project : public Operator {
         Operator *prior_op;     /**< prior operators                      */
         int64_t col_tot;        /**< number of columns being projected.   */
         int64_t col_rank[4];    /**< rank sets of columns projected       */
+        int64_t rowid_rank[4];  /**< rank of row id to materialize a column not in input, or -1 */
+        int64_t base_offset[4]; /**< offset of a materialized column in its record */
+        BasicType *col_type[4]; /**< types of columns projected           */
         RPattern in_RP;         /**< inside class use                     */
     public:
         /**
@@ -563,7 +785,7 @@ class Project : public Operator {
             in_col_type = new BasicType *[in_colnum];
             for(int i=0; i < in_colnum; i++)
                 in_col_type[i] = this->in_RP.getColumnType(i);
-            this->result.init(in_col_type, in_colnum);
+            this->result.init(in_col_type, in_colnum, row_buffer_size(this->in_RP.getRowSize()));
         }
         /**
          * @brief Write a row
@@ -576,7 +798,10 @@ class Project : public Operator {
                 return false;
             }
             for (int i = 0; i < col_tot; i++) { 
-                buffer = this->result.get_RC(0L, col_rank[i]);
+                if (rowid_rank[i] >= 0)
+                    buffer = *(char **)this->result.get_RC(0L, rowid_rank[i]) + base_offset[i];
+                else
+                    buffer = this->result.get_RC(0L, col_rank[i]);
                 if (!result->write_RC(0, i, buffer)) {
                     return false;
                 }
@@ -602,18 +827,23 @@ class OrderBy :public Operator {
         Operator *prior_op;              /**< prior Operator                       */ 
         int64_t index = 0;               /**< index that has been ordered          */
         int64_t col_num = 0;             /**< number of columns                    */
-        int64_t record_size;             /**< size of each record                  */
+        int64_t record_size = 0;         /**< number of records                    */
         int64_t row_length;              /**< length of each row                   */
-        BasicType *compare_col_type[4];  /**< column types of compare conditons    */
         int64_t compare_col_rank[4];     /**< ranks of each compare condtions      */
-        int64_t compare_col_offset[4];   /**< offset of each compared columns      */
         int64_t order_by_num;            /**< number of order conditions           */
-        ResultTable re;                  /**< temp result table to store result    */
+        RowSorter sorter;                /**< sort by normalized keys of compared columns */
+        std::vector<char> runs;          /**< records, each run in order           */
+        std::vector<char> keys;          /**< normalized key of each record in runs */
+        std::vector<std::vector<int64_t> > bounds; /**< rank in runs of first record of each partition, per run */
+        std::vector<int64_t> part_begin; /**< rank in output of first record of each partition, and record number */
+        RunMerger merger;                /**< merge of first partition, read by get_Next */
+        std::vector<std::thread> mergers;/**< merge threads of partitions after the first */
+        std::vector<char> rows;          /**< records of partitions after the first, in order */
+        size_t part = 0;                 /**< partition of current record          */
+        std::vector<SpillFile *> spilled;/**< sorted runs spilled to disk, empty if sorted in memory */
+        SpillMerger spill_merger;        /**< merge of spilled runs, read by get_Next */
         RPattern rpattern;               /**< inside class use                     */
         RequestColumn *in_cols_name;     /**< inside class use                     */
-        int64_t low;                     /**< inside class use                     */
-        int64_t high;                    /**< inside class use                     */
-        char *key;                       /**< inside class use                     */
     public:
         /**
          * @brief construction of OrderBy
@@ -622,24 +852,8 @@ class OrderBy :public Operator {
          * @param cols_name names of columns 
          */
         OrderBy(Operator * op_ptr, int64_t order_by_num, RequestColumn *cols_name);
-        /**
-         * @brief quick sort 
-         * @param buffer the begin of orderby address
-         * @param left left (low)side of order sequence
-         * @param right right (high)side of order sequence 
-         */
-        void quick_sort(char *buffer ,int64_t left, int64_t right);
-        /**
-         * @brief compare tow buffers 
-         * @param l first buffer
-         * @param r second buffer 
-         * @retval 2 for >
-         * @retval 1 for =
-         * @retval 0 for <
-         */
-        int cmp(void*l,void*r);
         /** 
-         * @brief init of project 
+         * @brief init, read and sort all records of prior operator
          */
         bool    init();
         /**
@@ -663,74 +877,47 @@ class OrderBy :public Operator {
         bool    close() ;
     private:
         /**
-         * @brief get pointer to prior Operator
-         * @retval pointer to prior Operator
+         * @brief sort runs of records in parallel and split them into partitions of the output
+         * @param input records of prior operator
+         * @param num number of records
          */
-        Operator *get_prior_operator(){
-            return this->prior_op;
-        }
+        void sort_runs(const char *input, int64_t num);
         /**
-         * @brief get index that has been ordered
-         * @retval index that has been ordered
+         * @brief merge a partition into rows, the work of one merge thread
+         * @param p rank of the partition, at least 1
          */
-        int64_t get_index(){
-            return this->index;
-        }
+        void merge_part(int64_t p);
         /**
-         * @brief get number of columns
-         * @retval number of columns
+         * @brief sort records and spill them to disk as one run
+         * @param input records of prior operator
+         * @param num number of records
+         * @retval false for failure
          */
-        int64_t get_number_of_columns(){
-            return this->col_num;
-        }
+        bool spill_run(const char *input, int64_t num);
         /**
-         * @brief get size of each record
-         * @retval size of each record
+         * @brief remove runs spilled by a previous run
          */
-        int64_t get_record_size(){
-            return this->record_size;
+        void drop_spilled(){
+            for(size_t r = 0; r < this->spilled.size(); r++)
+                delete this->spilled[r];
+            this->spilled.clear();
         }
         /**
-         * @brief get length of each row
-         * @retval length of each row
+         * @brief wait for merge threads of a previous run
          */
-        int64_t get_row_length(){
-            return this->row_length;
-        }
-        /**
-         * @brief get ptr to column types of compare conditons
-         * @retval ptr to column types of compare conditons
-         */
-        BasicType **get_compare_col_type_ptr(){
-            return this->compare_col_type;
-        }
-        /**
-         * @brief get ptr to ranks of each compare condtions
-         * @retval ptr to ranks of each compare condtions
-         */
-        int64_t *get_compare_col_rank(){
-            return this->compare_col_rank;
-        }
-        /**
-         * @brief get ptr to offset of each compared columns
-         * @retval ptr to offset of each compared columns
-         */
-        int64_t *get_compare_col_offset(){
-            return this->compare_col_offset;
-        }
-        /**
-         * @brief get number of order conditions
-         * @retval number of order conditions
-         */
-        int64_t get_order_by_num(){
-            return this->order_by_num;
+        void finish_merge(){
+            for(size_t t = 0; t < this->mergers.size(); t++){
+                if (this->mergers[t].joinable())
+                    this->mergers[t].join();
+            }
+            this->mergers.clear();
         }
         /**
-         * @brief get temp result table to store result
-         * @retval temp result table to store result
+         * @brief get pointer to prior Operator
+         * @retval pointer to prior Operator
          */
-        ResultTable get_ResultTable(){
-            return this->re;
+        Operator *get_prior_operator(){
+            return this->prior_op;
         }
         /**
          * @brief get rpattern
@@ -762,18 +949,18 @@ class OrderBy :public Operator {
             }
         }
         /**
-         * @brief init col
+         * @brief init col, compared columns are the keys of the sorter
          */
         void init_col(){
+            std::vector<SortKey> keys;
             for(int i = 0;i < this->order_by_num;i++)
             {
                 Object *col_ptr = g_catalog.getObjByName(this->in_cols_name[i].name);
-                // this->compare_col_rank[i] = this->get_prior_operator()->getTableOut()->getColumnRank(col_ptr->getOid());
-                // this->compare_col_rank[i] = this->get_prior_tableout()->getColumnRank(col_ptr->getOid());
                 this->compare_col_rank[i] = this->get_prior_col_rank(col_ptr->getOid());
-                this->compare_col_type[i] = this->get_rpattern().getColumnType(compare_col_rank[i]);
-                this->compare_col_offset[i] = this->get_rpattern().getColumnOffset(compare_col_rank[i]);
+                BasicType *type = this->get_rpattern().getColumnType(compare_col_rank[i]);
+                keys.push_back({this->result.offset[compare_col_rank[i]], type_ops(type)});
             }
+            this->sorter.init(this->row_length, keys);
         }
         /**
          * @brief check not end
@@ -781,45 +968,76 @@ class OrderBy :public Operator {
         bool check_not_end(){
             return (!this->get_prior_operator()->is_End() && this->get_prior_operator()->get_Next(&this->result));
         }
+};
+
+/** definition of TopN, OrderBy with a limit, only the first rows of the order are kept. */
+class TopN : public Operator {
+    private:
+        Operator *prior_op;                     /**< prior Operator                       */
+        int64_t limit;                          /**< number of rows to keep               */
+        int64_t order_by_num;                   /**< number of order conditions           */
+        TypeOps compare_col_ops[4];             /**< typed compare of each compared column */
+        int64_t compare_col_rank[4];            /**< rank of each compared column         */
+        int64_t compare_col_offset[4];          /**< offset of each compared column in row */
+        int64_t row_length = 0;                 /**< length of each row                   */
+        int col_num = 0;                        /**< number of columns                    */
+        ResultTable tmp_one;                    /**< buffer to store one input row        */
+        bool built = false;                     /**< tmp_one is allocated by a run        */
+        std::vector<std::vector<char> > heaps;  /**< rows kept by each thread, a heap with the last row in order on top */
+        std::vector<char> rows;                 /**< rows kept, in order                  */
+        int64_t row_num = 0;                    /**< number of rows kept                  */
+        int64_t index = 0;                      /**< index of next row to return          */
+    public:
         /**
-         * @brief write result col
+         * @brief construction of TopN
+         * @param op_ptr prior operators
+         * @param order_by_num number of condtions in order
+         * @param cols_name names of columns
+         * @param limit number of rows to return
          */
-        void write_result_col(int row, char *buffer){
-            for(int j = 0;j < this->col_num;j++)
-            {
-                buffer = result.get_RC(0, j);
-                re.write_RC(row, j, buffer); 
-            }
-        }
+        TopN(Operator *op_ptr, int64_t order_by_num, RequestColumn *cols_name, int64_t limit);
         /**
-         * @brief 
+         * @brief init, rank all rows of prior operator
          */
-        void qsort_helper(char *buffer){
-            while(this->low < this->high)
-            {
-                while(this->low < this->high && cmp(buffer + this->high * this->row_length, this->key))
-                    this->high --;
-                memcpy(buffer+this->low*this->row_length, buffer + this->high*this->row_length, this->row_length);
-
-                while(this->low <this->high && cmp(this->key, buffer + this->low*this->row_length) )
-                    this->low++;
-                memcpy(buffer + this->high*this->row_length , buffer + this->low*this->row_length, this->row_length);
-
+        bool    init();
+        /**
+         * @brief get next record of operator
+         * @param result buffer to store result
+         * @retval false for failure
+         * @retval true  for success
+         */
+        bool    get_Next(ResultTable *result);
+        /**
+         * @brief judge whether is end
+         * @retval false not end
+         * @retval true  run end
+         */
+        bool    is_End();
+        /**
+         * @brief close operator and release memory.
+         * @retval false for failure
+         * @retval true  for success
+         */
+        bool    close();
+    private:
+        /**
+         * @brief whether row l comes before row r in order
+         */
+        bool less(const char *l, const char *r){
+            for(int i = 0; i < order_by_num; i++){
+                int c = compare_col_ops[i].compare(l + compare_col_offset[i], r + compare_col_offset[i], compare_col_ops[i].size);
+                if (c != 0)
+                    return c < 0;
             }
+            return false;
         }
         /**
-         * @brief 
+         * @brief keep the first limit rows of a range, the work of one ranking thread
+         * @param heap rows kept by the thread
+         * @param rows rows one after another
+         * @param num number of rows
          */
-        bool check_stop_get_Next(ResultTable *result, char *buffer){
-            for(int i = 0;i < this->col_num; i++)
-            {
-                buffer = this->re.get_RC(this->index, i); 
-                if(!result->write_RC(0, i, buffer)){
-                return false;
-                }
-            }    
-            return true;
-        }
+        void rank_rows(std::vector<char> *heap, const char *rows, int64_t num);
 };
 
 /** definition of GroupBy */
@@ -836,16 +1054,30 @@ class GroupBy : public Operator {
         int aggrerate_index = 0;                /**< index has been group                 */
         int non_aggrerate_index = 0;            /**< index of non aggrerated              */
         AggrerateMethod aggrerate_method[4];    /**< aggrerate methods                    */
+        AggregateOps aggrerate_ops[4];          /**< kernels of each aggrerate            */
+        int64_t aggrerate_state[4];             /**< offset of accumulator of each aggrerate in entry */
+        TypeOps non_aggrerate_ops[4];           /**< typed hash of each group column      */
+        int64_t non_aggrerate_oid[4];           /**< oid of each group column, -1 if unknown */
+        int64_t (*direct_load[4])(const char *);/**< integer value of each group column   */
+        int64_t direct_min[4];                  /**< smallest key of each group column in direct array */
+        int64_t direct_span[4];                 /**< number of keys of each group column in direct array */
+        int64_t direct_stride[4];               /**< entries between keys of each group column */
+        int64_t direct_groups = 0;              /**< entries of direct array, 0 if groups are only hashed */
+        std::vector<std::vector<char> > directs;/**< direct array of each thread, entries with count 0 are empty */
         ResultTable tmp_one;                    /**< buffer to store one result           */
-        ResultTable tmp_result;                 /**< buffer to store tmp result           */ 
+        std::vector<AggTable> partials;         /**< groups of each thread, a row followed by its count and accumulators */
+        std::vector<AggTable> groups;           /**< final groups, one table per hash partition */
+        int64_t entry_size = 0;                 /**< size of a group entry                */
+        std::vector<int64_t> out_offset;        /**< offset of each column in output row  */
+        int64_t out_length = 0;                 /**< length of output row                 */
         int col_num = 0;                        /**< number of column                     */
-        int index = 0;                          /**< index of current                     */
+        std::vector<char *> outputs;            /**< entries of all groups in output order */
+        std::vector<AggKey> group_keys;         /**< group columns of an entry            */
+        std::vector<std::pair<SpillFile *, int64_t> > spilled; /**< partitions of entries spilled to disk, and times each was split */
+        size_t index = 0;                       /**< index of current in outputs          */
         RequestColumn *req_col_ptr;             /**< inside class use                     */
         RPattern rpattern;                      /**< inside class use                     */
-        int agg_i;                              /**< inside class use                     */
-        char* datain;                           /**< inside class use                     */
-        char* dataout;                          /**< inside class use                     */
-        int64_t *pattern_count_ptr;             /**< inside class use                     */
+        bool built = false;                     /**< tmp_one is allocated by a run        */
     public:
         /**
          * @brief construction of OrderBy
@@ -886,21 +1118,87 @@ class GroupBy : public Operator {
          */
         int64_t hash(char *str, int64_t length);
         /**
-         * @brief do aggregation on a column
-         * @param method Aggregation method
-         * @param probe_result the result of hashtable::probe
-         * @param agg_i the index of aggregation
-         * @retval false for failure 
-         * @retval true  for success 
+         * @brief fold a batch of rows into accumulators of their groups
+         * @param entries group of each row
+         * @param rows rows of the batch
+         * @param row_num number of rows
+         */
+        void aggrerate(char *const *entries, const char *const *rows, int64_t row_num);
+        /**
+         * @brief hash of the group columns of a row
+         */
+        uint64_t group_hash(const char *row);
+        /**
+         * @brief choose a direct array of groups if the key domain is small
+         * @param rows first chunk of rows, bounds keys without statistics
+         * @param row_num number of rows
+         * @retval true if groups are kept in a direct array
+         */
+        bool init_direct(const char *rows, int64_t row_num);
+        /**
+         * @brief entry rank of the group of a row in the direct array
+         * @retval rank, -1 if a key is out of the direct domain
          */
-        bool aggrerate(AggrerateMethod method, uint64_t probe_result, int agg_i);
+        int64_t direct_rank(const char *row){
+            int64_t rank = 0;
+            for(int i = 0; i < non_aggrerate_num; i++){
+                int64_t key = direct_load[i](row + tmp_one.offset[non_aggrerate_off[i]]) - direct_min[i];
+                if ((uint64_t)key >= (uint64_t)direct_span[i])
+                    return -1;
+                rank += key * direct_stride[i];
+            }
+            return rank;
+        }
+        /**
+         * @brief fold rows into groups of a thread, the work of one aggregation thread
+         * @param thread rank of the thread, owner of a partial table and a direct array
+         * @param rows rows one after another
+         * @param row_num number of rows
+         */
+        void aggrerate_rows(int64_t thread, const char *rows, int64_t row_num);
+        /**
+         * @brief merge partial groups of one hash partition, the work of one merge thread
+         * @param table final groups of the partition
+         * @param part rank of the partition
+         * @param part_num number of partitions
+         */
+        void merge_partition(AggTable *table, int64_t part, int64_t part_num);
+        /**
+         * @brief fold an entry into the entry of its group
+         * @param table groups to merge into
+         * @param hash hash of the group columns of src
+         * @param src entry, its row and accumulators
+         */
+        void merge_entry(AggTable *table, uint64_t hash, const char *src);
+        /**
+         * @brief write entries of partial groups to partitions on disk, and empty the partial tables
+         * @param parts files of partitions, opened if empty
+         * @retval false for failure
+         */
+        bool spill_partials(std::vector<SpillFile *> &parts);
+        /**
+         * @brief merge the next partition spilled to disk into outputs, or split it if too large
+         * @retval false if no partition is left
+         */
+        bool next_partition();
+        /**
+         * @brief remove partitions spilled by a previous run
+         */
+        void drop_spilled(){
+            for(size_t p = 0; p < this->spilled.size(); p++)
+                delete this->spilled[p].first;
+            this->spilled.clear();
+        }
 
         /**
          * @brief init non_aggre
          */
         void init_non_aggre(int64_t col_rank){
             this->non_aggrerate_off[non_aggrerate_index] = col_rank;
-            this->non_aggrerate_type[non_aggrerate_index] = table_out->getRPattern().getColumnType(col_rank);
+            this->non_aggrerate_type[non_aggrerate_index] = this->rpattern.getColumnType(col_rank);
+            this->non_aggrerate_ops[non_aggrerate_index] = type_ops(this->non_aggrerate_type[non_aggrerate_index]);
+            Object *col = g_catalog.getObjByName(this->req_col_ptr[col_rank].name);
+            this->non_aggrerate_oid[non_aggrerate_index] = col != NULL ? col->getOid() : -1;
             this->non_aggrerate_num++;
             this->non_aggrerate_index++;
         }
@@ -909,8 +1207,9 @@ class GroupBy : public Operator {
          */
         void init_aggre(int64_t col_rank){
             this->aggrerate_off[aggrerate_index] = col_rank;
-            this->aggrerate_type[aggrerate_index] = table_out->getRPattern().getColumnType(col_rank);
+            this->aggrerate_type[aggrerate_index] = this->rpattern.getColumnType(col_rank);
             this->aggrerate_method[aggrerate_index] = this->req_col_ptr[col_rank].aggrerate_method;
+            this->aggrerate_ops[aggrerate_index] = aggregate_ops(this->aggrerate_method[aggrerate_index], this->aggrerate_type[aggrerate_index]);
             this->aggrerate_num++;
             this->aggrerate_index++;
         }
@@ -950,97 +1249,36 @@ class GroupBy : public Operator {
             return this->rpattern;
         }
         /**
-         * @brief sum handler
-         * 
+         * @brief write the result of a group, results are produced from accumulators and its count
+         * @param entry group
+         * @param out result row
          */
-        void sum_handler(){
-
-        }
-        /**
-         * @brief avg handler
-         * 
-         */
-        bool avg_handler(){
-            switch (aggrerate_type[this->agg_i]->getTypeCode()){
-                case INT8_TC: {
-                    int8_t agg_result = *(int8_t *)this->datain + *(int8_t *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 1);
-                    break;
-                }
-                case INT16_TC: {
-                    int16_t agg_result = *(int16_t *)this->datain + *(int16_t *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 2);
-                    break;
-                }
-                case INT32_TC: {
-                    int32_t agg_result = *(int32_t *)this->datain + *(int32_t *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 4);
-                    break;
-                }
-                case INT64_TC: {
-                    int64_t agg_result = *(int64_t *)this->datain + *(int64_t *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 8);
-                    break;
-                }
-                case FLOAT32_TC: {
-                    float agg_result = *(float *)this->datain + *(float *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 4);
-                    break;
-                }
-                case FLOAT64_TC: {
-                    double agg_result = *(double *)this->datain + *(double *)this->dataout;
-                    memcpy(this->dataout, (void*)&agg_result, 8);
-                    break;
-                }
-                default:
-                    return false;
+        void aggrerate_method_handler(char *entry, char *out){
+            int64_t group_count = load_value<int64_t>(entry + tmp_one.row_length);
+            memset(out, 0, this->out_length);
+            for(int i = 0; i < non_aggrerate_num; i++){
+                int64_t col_rank = non_aggrerate_off[i];
+                memcpy(out + out_offset[col_rank], entry + tmp_one.offset[col_rank], non_aggrerate_ops[i].size);
             }
-            return true;   
-        }
-        /**
-         * @brief aggrerate_method handler
-         * 
-         */
-        void aggrerate_method_handler(int64_t hash_count){
-            for(int j = 0; j < hash_count; j++){
-                for(int k = 0; k < aggrerate_num; k++){
-                    auto datain = tmp_result.get_RC(j, aggrerate_off[k]);
-                    float avg_result = 0;
-                    switch(this->aggrerate_method[k]){
-                        case COUNT:
-                            this->aggrerate_type[k]->copy(datain, &(this->pattern_count_ptr[j]));
-                            break;
-                        case AVG:
-                            avg_result = *(float *)this->datain;
-                            memcpy(this->datain, (void*)&avg_result, 4);
-                            break;
-                        default:
-                            break;
-                    }            
-                }
+            for(int k = 0; k < aggrerate_num; k++){
+                if (this->aggrerate_ops[k].result != NULL)
+                    this->aggrerate_ops[k].result(entry + aggrerate_state[k], group_count, out + out_offset[aggrerate_off[k]], this->aggrerate_ops[k].size);
             }
         }
+};
 
-        /**
-         * @brief 
-         */
-        void max_handler(){
-            if(this->aggrerate_type[this->agg_i]->cmpLT(dataout, datain)){
-                this->aggrerate_type[this->agg_i]->copy(dataout, datain);                  
-            }    
-        }
-
-        /**
-         * @brief 
-         */
-        void min_handler(){
-            if(this->aggrerate_type[this->agg_i]->cmpLT(datain, dataout))
-                this->aggrerate_type[this->agg_i]->copy(dataout, datain);            
-        }
+/** definition of PreparedPlan, an operator tree kept for queries of one shape. */
+struct PreparedPlan {
+    Operator *top_op = NULL;        /**< root of the operator tree                  */
+    std::vector<Scan *> scans;      /**< scans of the tree, their constants are rebound */
+    bool in_use = false;            /**< an Executor is reading records of the tree */
+    std::vector<int64_t> stats_versions; /**< Catalog::getStatsVersion of each from table when planned */
 };
 
 class Executor {
     private:
+        PreparedPlan *plan = NULL;   /**< cached plan being executed, NULL if not cached */
+        std::vector<Scan *> scans;   /**< scans of the operator tree being built   */
         Operator    *top_op = NULL;  /**< Top operator of the operator tree.   */
         BasicType   **result_type;   /**< Type of every column in result table.*/
         int64_t     *filter_tid;     /**< Table id of filter conditions.       */
@@ -1051,7 +1289,13 @@ class Executor {
         int64_t     *joinA_tid;      /**< inside class use                     */
         int64_t     *joinB_tid;      /**< inside class use                     */
         int         join_count;      /**< inside class use                     */
+        int64_t     limit = 0;       /**< records the query may still return, 0 for no limit */
     public:
+        /**
+         * @brief destructor, releases the operator tree, see close.
+         */
+        virtual ~Executor();
+
         /**
          * @brief exec function.
          * @param  query to execute, if NULL, execute query at last time 
@@ -1062,7 +1306,7 @@ class Executor {
         virtual int exec(SelectQuery *query, ResultTable *result);
 
         /**
-         * @brief close function.
+         * @brief close function, gives a cached tree back to the plan cache or closes the tree.
          * @param None
          * @retval ==0 succeed to close
          * @retval !=0 fail to close
@@ -1070,6 +1314,13 @@ class Executor {
         virtual int close();
 
     private:
+        /**
+         * @brief key of the shape of a query, constants of filter and having conditions are left out
+         * @param selected query
+         * @retval key text, queries of equal keys run the same operator tree
+         */
+        static std::string plan_key(SelectQuery *query);
+
         /**
          * @brief count join link number 
          * @param selected query
@@ -1152,53 +1403,94 @@ class Executor {
             }            
         }
 
+        /**
+         * @brief estimate the output records of an equi-join, |A|*|B|/max(distinct A, distinct B)
+         * without statistics the join key is assumed unique in the smaller base table
+         * @param rows_a estimated records on the side of column A of join condition
+         * @param rows_b estimated records on the side of column B of join condition
+         * @param cond rank of join condition in join_cond
+         * @param query selected query
+         * @retval estimated records of the join
+         */
+        double estimate_join_rows(double rows_a, double rows_b, int cond, SelectQuery *query);
+
+        /**
+         * @brief choose the order in which tables are joined
+         * every connected left-deep order is costed, each hash join pays for
+         * building its smaller input, probing the larger one and its output
+         * @param Op scan (and filter) operators of each table in from list
+         * @param query selected query
+         * @param order returns ranks in from list, in join order
+         * @retval false if tables are not connected by join conditions
+         */
+        bool choose_join_order(Operator **Op, SelectQuery *query, int *order);
+
+        /**
+         * @brief build a left-deep join tree, each input is joined exactly once
+         * the rows of the first input stream through the hash joins with the
+         * other inputs, each hash join builds on its smaller side
+         * @param Op scan (and filter) operators of each table in from list
+         * @param query selected query
+         * @retval root of the join tree, NULL if tables are not connected
+         */
+        Operator *build_join_tree(Operator **Op, SelectQuery *query);
+
+        /**
+         * @brief find columns of a table required above Scan
+         * join columns always, select, group by and order by lists if asked
+         * @param query selected query
+         * @param table table in from list
+         * @param with_select also collect columns of select, group by and order by lists
+         * @param col_oids returns object ids of the columns, room for 24
+         * @retval number of columns found
+         */
+        int64_t required_columns(SelectQuery *query, Table *table, bool with_select, int64_t *col_oids);
+
         /**
          * @brief build_op_tree
          * @param selected query, operator
          */
         void build_op_tree(Operator **Op, SelectQuery *query){
+            top_op = NULL;
+            this->scans.clear();
             for(int i = 0; i < query->from_number; i++){
 
                 RowTable *row_table = (RowTable *)g_catalog.getObjByName(query->from_table[i].name);
-                Op[i] = new Scan(query->from_table[i].name);
+                if (query->select_number > 0) {
+                    // only required columns are scanned, joins carry condition columns
+                    // and row ids, Project fetches the rest (late materialization)
+                    bool late = query->from_number > 1;
+                    int64_t col_oids[24];
+                    int64_t col_tot = this->required_columns(query, row_table, !late, col_oids);
+                    Op[i] = new Scan(query->from_table[i].name, col_tot, col_oids, late);
+                }
+                else
+                    Op[i] = new Scan(query->from_table[i].name);
 
+                // filter conditions are evaluated by Scan on the records
+                Scan *scan = (Scan *)Op[i];
+                this->scans.push_back(scan);
                 int64_t row_tid = row_table->getOid();
                 for(int j = 0; j < 4; j++){
                     if(this->filter_tid[j] == row_tid) {
-                        Op[i] = new Filter(Op[i], &query->where.condition[j]); 
+                        scan->addPredicate(&query->where.condition[j], j);
                     }
                     if(having_tid[j] == row_tid) {
-                        Op[i] = new Filter(Op[i], &query->having.condition[j]); 
+                        scan->addPredicate(&query->having.condition[j], 4 + j);
                     }
                 }
             }       
 
-            Operator *newop;
-            printf("DEBUG 55    %d\n", this->join_count);
-            if(this->join_count>1) {
-                Operator ***hash_op = new Operator **[4];
-                for (int i = 0; i < this->join_count; i++) {
-                    hash_op[i] = new Operator*[2];
-                    hash_op[i][0] = Op[this->joinA_tid[i]];
-                    hash_op[i][1] = Op[this->joinB_tid[i]];
-                    printf("DEBUG 56 %d %d %d \n", i, this->joinA_tid[i], this->joinB_tid[i]);
-                    newop = new HashJoin(2, hash_op[i], 1, this->join_cond[i]);
-                    
-                    Op[this->joinA_tid[i]] = newop;
-                    Op[this->joinB_tid[i]] = newop;
-                }
-            //  return false;
-            }
-            else if (this->join_count == 1) {
-                newop = new HashJoin(2, Op, 1, this->join_cond[0]);
-            }
-            else newop = Op[0];
-            
+            Operator *newop = this->build_join_tree(Op, query);
+            if (newop == NULL)
+                return;
             if(query->select_number)
                 newop = new Project(newop, query->select_number, query->select_column);
             if(query->groupby_number)
                 newop = new GroupBy(newop, query->select_number, query->select_column);
-            if(query->orderby_number)
+            if(query->orderby_number && query->limit > 0)
+                newop = new TopN(newop, query->orderby_number, query->orderby, query->limit);
+            else if(query->orderby_number)
                 newop = new OrderBy(newop, query->orderby_number, query->orderby);
             //---------------------init the operator tree ---------------------
             top_op = newop;
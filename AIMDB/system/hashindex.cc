@@ -24,6 +24,7 @@
 bool HashIndex::init(void)
 {
     ih_column_num = 0L;
+    ih_entry_num = 0L;
     ih_column_cap = getIKey().getKey().size();
     ih_datatype = new BasicType *[ih_column_cap];
     ih_hash_bits = new int64_t[ih_column_cap];
@@ -43,9 +44,9 @@ bool HashIndex::addIndexDTpye(BasicType * i_dt)
 
 bool HashIndex::finish(void)
 {                               // for hash setting
-    int64_t average = ih_cell_capbits / ih_column_cap;
+    int64_t average = HASHINDEX_CODE_BITS / ih_column_cap;
     average = (average == 0 ? 1 : average);
-    int64_t leftover = ih_cell_capbits;
+    int64_t leftover = HASHINDEX_CODE_BITS;
     for (int64_t ii = 0; ii < ih_column_cap; ii++) {
         int64_t bits = ih_datatype[ii]->getTypeSize() << 3;     // *8bits
         int64_t actu = bits <= average ? bits : average;
@@ -68,13 +69,26 @@ bool HashIndex::shut(void)
 bool HashIndex::insert(void *i_data, void *p_in)
 {
     int64_t key = tranToInt64(i_data);
-    return ih_hashtable->add(key,(char*)p_in);
+    if (ih_hashtable->add(key,(char*)p_in) == false)
+        return false;
+    return grow();
 }
 
 bool HashIndex::insert(void *i_data[], void *p_in)
 {
     int64_t key = tranToInt64(i_data);
-    return ih_hashtable->add(key,(char*)p_in);
+    if (ih_hashtable->add(key,(char*)p_in) == false)
+        return false;
+    return grow();
+}
+
+bool HashIndex::grow(void)
+{
+    ih_entry_num++;
+    if (ih_entry_num <= (HASHINDEX_MAX_LOAD << ih_cell_capbits))
+        return true;
+    ih_cell_capbits += 2;
+    return ih_hashtable->resize(1 << ih_cell_capbits);
 }
 
 bool HashIndex::del(void *i_data)
@@ -91,7 +105,10 @@ bool HashIndex::del(void *i_data)
         printf("[HashIndex][INFO][del]: not found error! -2\n");
         return false;
     }
-    return ih_hashtable->del(info.hash, (char*)result);
+    if (ih_hashtable->del(info.hash, (char*)result) == false)
+        return false;
+    ih_entry_num--;
+    return true;
 }
 
 bool HashIndex::del(void *i_data[])
@@ -108,7 +125,10 @@ bool HashIndex::del(void *i_data[])
         printf("[HashIndex][INFO][del]: not found error! -2\n");
         return false;
     }
-    return ih_hashtable->del(info.hash, (char*)result);
+    if (ih_hashtable->del(info.hash, (char*)result) == false)
+        return false;
+    ih_entry_num--;
+    return true;
 }
 
 // the following function can pull one by one 
@@ -27,6 +27,8 @@
 
 // support INT and CHARN, id type data
 #define HASHINFO_CAPICITY (8)
+#define HASHINDEX_CODE_BITS (62)   // bits of hash code, independent of the number of cells
+#define HASHINDEX_MAX_LOAD  (2)    // entries per cell before the hash table grows
 
 /** definition of HashInfo.  */
 struct HashInfo {
@@ -46,6 +48,7 @@ class HashIndex:public Index {
     BasicType **ih_datatype;  /**< each column data type */
     int64_t ih_column_num;    /**< current number of added columns */
     int64_t ih_column_cap;    /**< got from parent class, the number of columns in the key */
+    int64_t ih_entry_num;     /**< number of entries in hash table */
 
   public:
     /**
@@ -65,7 +68,7 @@ class HashIndex:public Index {
      */
     bool init (void);
     /**
-     * set hashtable cell capicity.
+     * set initial hashtable cell capicity, the hashtable grows with the number of entries.
      * @param cell_capbits the number of cells in hashtable is 2^cell_capbits
      */
     void setCellCap(int64_t cell_capbits) {  // cell szie is power of cell_capbits by 2
@@ -157,6 +160,12 @@ class HashIndex:public Index {
     bool del(void *i_data[]);
 
   private:
+    /**
+     * count a new entry, enlarge hash table when entries exceed HASHINDEX_MAX_LOAD per cell.
+     * @retval true   success
+     * @retval false  failure
+     */
+    bool grow(void);
     /**
      * assemble hash keys, INT and CHARN.
      * @param  i_data buffer of column data
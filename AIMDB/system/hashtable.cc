@@ -1,18 +1,23 @@
 #include "hashtable.h"
 
 #define ESTIMATE_ERROR (1024)
-HashTable::HashTable(int estimatedNumDistinctKeys,
+HashTable::HashTable(int64_t estimatedNumDistinctKeys,
                      double estimatedDupPerKey, int num_partitions = 0)
+{
+    setup(estimatedNumDistinctKeys, estimatedDupPerKey);
+}
+
+void HashTable::setup(int64_t estimatedNumDistinctKeys, double estimatedDupPerKey)
 {
     estimated_num_distinct_keys = estimatedNumDistinctKeys;
     estimated_duplicates_per_key = estimatedDupPerKey;
     table_size = estimatedNumDistinctKeys;
 
-    int num_in_array;
+    int64_t num_in_array;
     num_in_array =
-        (int) (estimated_num_distinct_keys * estimated_duplicates_per_key);
+        (int64_t) (estimated_num_distinct_keys * estimated_duplicates_per_key);
     num_in_array += ESTIMATE_ERROR;
-    int size = table_size * sizeof(HashCell)
+    int64_t size = table_size * sizeof(HashCell)
         + num_in_array * sizeof(Hashcode_Ptr);
     if ((begin = (char *) allocate(size)) == NULL) {
         printf("error: allocate!\n");
@@ -22,14 +27,14 @@ HashTable::HashTable(int estimatedNumDistinctKeys,
     table = (HashCell *) begin;
 
 #ifndef HASHTABLE_CLASS_PREFETCH_BUCKET_HEADER
-    for (int ii = 0; ii < table_size; ii++)
+    for (int64_t ii = 0; ii < table_size; ii++)
         table[ii].hc_num = 0;
 
 #else
     // We prefetch for sizeof(HashCell)*L2_CACHE_LINE every time.
     // There are sizeof(HashCell) cache lines and L2_CACHE_LINE
     // hash cells.
-    int jj;
+    int64_t jj;
     char *pp;
     UNROLL_PREF(pfld, table, L2_CACHE_LINE, sizeof(HashCell));
     pp = ((char *) table) + L2_CACHE_LINE * sizeof(HashCell);
@@ -38,9 +43,9 @@ HashTable::HashTable(int estimatedNumDistinctKeys,
         UNROLL_PREF(pfld, pp, L2_CACHE_LINE, sizeof(HashCell));
         pp += L2_CACHE_LINE * sizeof(HashCell);
         pfld(pp[-1]);
-        for (int ii = jj - L2_CACHE_LINE; ii < jj; ii++) {
+        for (int64_t ii = jj - L2_CACHE_LINE; ii < jj; ii++) {
             table[ii].hc_num = 0;
-    }} for (int ii = jj - L2_CACHE_LINE; ii < table_size; ii++) {
+    }} for (int64_t ii = jj - L2_CACHE_LINE; ii < table_size; ii++) {
         table[ii].hc_num = 0;
     }
 #endif   /* HASHTABLE_CLASS_PREFETCH_BUCKET_HEADER */
@@ -61,6 +66,29 @@ HashTable::~HashTable()
     }
 }
 
+bool HashTable::resize(int64_t estimatedNumDistinctKeys)
+{
+    // hash codes are stored with the tuples, so entries move without rehashing the data
+    std::vector<Hashcode_Ptr> entries;
+    for (int64_t ii = 0; ii < table_size; ii++) {
+        HashCell *hcp = &table[ii];
+        if (hcp->hc_num == 1)
+            entries.push_back(hcp->hc_ent);
+        else if (hcp->hc_num > 1)
+            entries.insert(entries.end(), hcp->hc_ents, hcp->hc_ents + hcp->hc_num);
+    }
+    for (auto it = pointer2size.begin(); it != pointer2size.end(); it++) {
+        g_memory.free ((char*)it->first,it->second);
+    }
+    pointer2size.clear();
+    setup(estimatedNumDistinctKeys, estimated_duplicates_per_key);
+    for (size_t ii = 0; ii < entries.size(); ii++) {
+        if (!add(entries[ii].hash_code, entries[ii].tuple))
+            return false;
+    }
+    return true;
+}
+
 // array_size = 2^k * initial_array_size
 // return k;
 int HashTable::size_to_slot(int array_size)
@@ -78,8 +106,7 @@ int HashTable::size_to_slot(int array_size)
 
 bool HashTable::add(int64_t hashCode, char *tup)
 {
-    int which = hashCode % table_size;
-    HashCell *hcp = &table[which];
+    HashCell *hcp = cellOf(hashCode);
     Hashcode_Ptr *pp;
     switch (hcp->hc_num) {
     case 0:
@@ -159,8 +186,7 @@ bool HashTable::add(int64_t hashCode, char *tup)
 
 bool HashTable::del(int64_t hashCode, char *tup) {
     // del function, added by liugang
-    int which = hashCode % table_size;
-    HashCell *hcp = &table[which];
+    HashCell *hcp = cellOf(hashCode);
     Hashcode_Ptr *pp;
     switch (hcp->hc_num) {
     case 0:
@@ -215,8 +241,7 @@ bool HashTable::del(int64_t hashCode, char *tup) {
 //          use -ret as "last" to call the probe_contd
 int HashTable::probe(int64_t hashCode, char *match[], int capacity)
 {
-    int which = hashCode % table_size;
-    HashCell *hcp = &table[which];
+    HashCell *hcp = cellOf(hashCode);
     Hashcode_Ptr *pp;
     switch (hcp->hc_num) {
     case 0:
@@ -255,8 +280,7 @@ int HashTable::probe(int64_t hashCode, char *match[], int capacity)
 int HashTable::probe_contd(int64_t hashCode, int last, char *match[],
                            int capacity)
 {
-    int which = hashCode % table_size;
-    HashCell *hcp = &table[which];
+    HashCell *hcp = cellOf(hashCode);
     if (hcp->hc_num > last) {
         Hashcode_Ptr *pp = &(hcp->hc_ents[last]);
         int jj = 0;
@@ -279,9 +303,9 @@ int HashTable::probe_contd(int64_t hashCode, int last, char *match[],
     return 0;
 }
 
-void* HashTable::allocate(int size)
+void* HashTable::allocate(int64_t size)
 {
-    int allocate_size = 1;
+    int64_t allocate_size = 1;
     while(allocate_size < size)
         allocate_size = allocate_size << 1;
     if(allocate_size <= 0) {
@@ -293,7 +317,7 @@ void* HashTable::allocate(int size)
         printf("error: db system memory error!\n");
         return NULL;
     }
-    pointer2size.insert(std::pair<void*,int>(p,allocate_size)); 
+    pointer2size.insert(std::pair<void*,int64_t>(p,allocate_size)); 
     return p;
 }
 
@@ -307,30 +331,30 @@ void  HashTable::free(void *mem)
 
 void HashTable::utilization()
 {
-    int count = 0;
-    for (int ii = 0; ii < table_size; ii++) {
+    int64_t count = 0;
+    for (int64_t ii = 0; ii < table_size; ii++) {
         HashCell *hcp = &table[ii];
         if (hcp->hc_num == 0)
             count++;
     }
-    printf("%d out of %d are empty!\n", count, table_size);
+    printf("%ld out of %ld are empty!\n", count, table_size);
     printf("allocated %ld bytes more memory!\n",
            more_allocated * sizeof(Hashcode_Ptr));
 }
 
 void HashTable::show()
 {
-    printf("tablesize: %d\n", table_size);
-    for (int ii = 0; ii < table_size; ii++) {
+    printf("tablesize: %ld\n", table_size);
+    for (int64_t ii = 0; ii < table_size; ii++) {
         HashCell *hcp = &table[ii];
         if (hcp->hc_num != 0) {
             if (hcp->hc_num == 1) {
-                printf("cell[%d]: num(%d) (%ld, %p)\n", ii, hcp->hc_num,
+                printf("cell[%ld]: num(%d) (%ld, %p)\n", ii, hcp->hc_num,
                        hcp->hc_ent.hash_code, hcp->hc_ent.tuple);
             }
 
             else {
-                printf("cell[%d]: num(%d) capacity(%d) at %p\n", ii,
+                printf("cell[%ld]: num(%d) capacity(%d) at %p\n", ii,
                        hcp->hc_num, hcp->hc_capacity, hcp->hc_ents);
                 Hashcode_Ptr *pp = hcp->hc_ents;
                 printf("\t");
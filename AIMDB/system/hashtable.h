@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unordered_map>
+#include <vector>
 #include "mymemory.h"
 
 /* ------------------------------------------------------------------------- */
@@ -51,7 +52,7 @@ class HashCell {
 /** definition of class HashTable. */
 class HashTable {
   public:
-    int estimated_num_distinct_keys;     /**< estimated number of distinct keys,pre-knowledge for this HashTable usage */
+    int64_t estimated_num_distinct_keys; /**< estimated number of distinct keys,pre-knowledge for this HashTable usage */
     double estimated_duplicates_per_key; /**< estimated number of dupicate keys in average,pre-knowledge for this HashTable usage */
     int initial_array_size;              /**< when hc_num of HashCell exceeds 1 at the fist time, number of Hashcode_Ptr allcated for HashCell */
     char *begin;                         /**< start pointer of HashCells */
@@ -64,13 +65,22 @@ class HashTable {
     Hashcode_Ptr *avail;                 /**< pointer of next available Hashcode_Ptr */
     Hashcode_Ptr *end;                   /**< the end pointer of Hashcode_Ptr in array */
     HashCell *table;                     /**< pointer of an array of HashCell */
-    int table_size;                      /**< the number of HashCells in this table*/
+    int64_t table_size;                  /**< the number of HashCells in this table*/
     int more_allocated;                  /**< analysis of more memory allocated from g_memory */
   private:
-    std::unordered_map<void*, int> pointer2size;  /**< unordered map, memory pointer to its size,an adapter for mymemory component */
-    void *allocate(int size);                     /**< mymemory alloc interface like malloc */
+    std::unordered_map<void*, int64_t> pointer2size;  /**< unordered map, memory pointer to its size,an adapter for mymemory component */
+    void *allocate(int64_t size);                 /**< mymemory alloc interface like malloc */
     void  free(void *mem);                        /**< mymemory free interface like free in stdlib */
     int size_to_slot(int array_size);             /**< find the offset in free_header arrray to get suitable free memory used in this HashTable */
+    void setup(int64_t estimatedNumDistinctKeys, double estimatedDupPerKey);  /**< allocate and clear HashCells, used by constructor and resize */
+    /**
+     * get the HashCell of a hash code, codes are mixed first so that every bit
+     * of a code assembled from several columns picks the cell, not only its low bits
+     */
+    HashCell *cellOf(int64_t hashCode) {
+        uint64_t mixed = (uint64_t) hashCode * 0x9E3779B97F4A7C15ULL;
+        return &table[(mixed ^ (mixed >> 32)) % (uint64_t) table_size];
+    }
     
   public:
     /**
@@ -79,13 +89,20 @@ class HashTable {
      * @param estimatedDupPerKey       estimated number of dupicate keys in average,pre-knowledge for this HashTable usage
      * @param num_partitions           leave it 0, unuseable
      */
-    HashTable(int estimatedNumDistinctKeys, double estimatedDupPerKey,
+    HashTable(int64_t estimatedNumDistinctKeys, double estimatedDupPerKey,
                int num_partitions);
     /**
      * destructor, free HashTable memory to g_memory.
      */
     ~HashTable();
 
+    /**
+     * change the number of HashCells, all entries are kept.
+     * @param  estimatedNumDistinctKeys new estimated number of distinct keys
+     * @retval true     success
+     * @retval false    failure
+     */
+    bool resize(int64_t estimatedNumDistinctKeys);
     /**
      * add an entry.
      * @param  hashCode hash code of specified data
@@ -14,6 +14,7 @@
  */
 
 #include "rowtable.h"
+#include <functional>
 
 bool RowTable::init(void)
 {
@@ -162,6 +163,7 @@ bool RowTable::del(int64_t record_rank)
 
 bool RowTable::del(char *row_pointer)
 {
+    r_changes++;
     return invalid(row_pointer);
 }
 
@@ -188,9 +190,11 @@ bool RowTable::accessCol(int64_t record_rank, int64_t column_rank,
 bool RowTable::updateCol(char *row_pointer, int64_t column_rank,
                          char *source)
 {
+    r_changes++;
     int64_t of = r_pattern.getColumnOffset(column_rank);
-    if (of < 0)
+    if (of < 0 || !inDictionary(column_rank, source))
         return false;
+    zoneDrop(column_rank);
     return r_pattern.getColumnType(column_rank)->copy(row_pointer + of,
                                                       source) >
         0 ? true : false;
@@ -199,28 +203,55 @@ bool RowTable::updateCol(char *row_pointer, int64_t column_rank,
 bool RowTable::updateCol(int64_t record_rank, int64_t column_rank,
                          char *source)
 {
+    r_changes++;
     char *ptr = NULL;
     bool bl = access(record_rank, ptr);
     if (bl == false)
         return false;
-    return updateCol(ptr, column_rank, source);
+    int64_t of = r_pattern.getColumnOffset(column_rank);
+    if (of < 0 || !inDictionary(column_rank, source))
+        return false;
+    if (r_pattern.getColumnType(column_rank)->copy(ptr + of, source) <= 0)
+        return false;
+    zoneUpdate(record_rank, column_rank, ptr + of);
+    return true;
 }
 
 bool RowTable::updateCols(int64_t record_rank, int64_t column_total,
                           int64_t * column_ranks, char *source)
 {
+    r_changes++;
     char *ptr = NULL;
     bool bl = access(record_rank, ptr);
     if (bl == false)
         return false;
-    return updateCols(ptr, column_total, column_ranks, source);
+    for (int64_t ii = 0, pos = 0; ii < column_total; ii++) {
+        if (!inDictionary(column_ranks[ii], source + pos))
+            return false;
+        pos += r_pattern.getColumnType(column_ranks[ii])->getTypeSize();
+    }
+    for (int64_t ii = 0, pos = 0; ii < column_total; ii++) {
+        int64_t of = r_pattern.getColumnOffset(column_ranks[ii]);
+        pos +=
+            r_pattern.getColumnType(column_ranks[ii])->copy(ptr + of,
+                                                            source + pos);
+        zoneUpdate(record_rank, column_ranks[ii], ptr + of);
+    }
+    return true;
 }
 
 bool RowTable::updateCols(char *row_pointer, int64_t column_total,
                           int64_t * column_ranks, char *source)
 {
+    r_changes++;
+    for (int64_t ii = 0, pos = 0; ii < column_total; ii++) {
+        if (!inDictionary(column_ranks[ii], source + pos))
+            return false;
+        pos += r_pattern.getColumnType(column_ranks[ii])->getTypeSize();
+    }
     for (int64_t ii = 0, pos = 0; ii < column_total; ii++) {
         int64_t of = r_pattern.getColumnOffset(column_ranks[ii]);
+        zoneDrop(column_ranks[ii]);
         pos +=
             r_pattern.getColumnType(column_ranks[ii])->copy(row_pointer +
                                                             of,
@@ -232,18 +263,35 @@ bool RowTable::updateCols(char *row_pointer, int64_t column_total,
 bool RowTable::updateCols(int64_t record_rank, int64_t column_total,
                           int64_t * column_ranks, char *source[])
 {
+    r_changes++;
     char *ptr = NULL;
     bool bl = access(record_rank, ptr);
     if (bl == false)
         return false;
-    return updateCols(ptr, column_total, column_ranks, source);
+    for (int64_t ii = 0; ii < column_total; ii++) {
+        if (!inDictionary(column_ranks[ii], source[ii]))
+            return false;
+    }
+    for (int64_t ii = 0; ii < column_total; ii++) {
+        int64_t of = r_pattern.getColumnOffset(column_ranks[ii]);
+        r_pattern.getColumnType(column_ranks[ii])->copy(ptr + of,
+                                                        source[ii]);
+        zoneUpdate(record_rank, column_ranks[ii], ptr + of);
+    }
+    return true;
 }
 
 bool RowTable::updateCols(char *row_pointer, int64_t column_total,
                           int64_t * column_ranks, char *source[])
 {
+    r_changes++;
+    for (int64_t ii = 0; ii < column_total; ii++) {
+        if (!inDictionary(column_ranks[ii], source[ii]))
+            return false;
+    }
     for (int64_t ii = 0; ii < column_total; ii++) {
         int64_t of = r_pattern.getColumnOffset(column_ranks[ii]);
+        zoneDrop(column_ranks[ii]);
         r_pattern.getColumnType(column_ranks[ii])->copy(row_pointer + of,
                                                         source[ii]);
     }
@@ -253,6 +301,11 @@ bool RowTable::updateCols(char *row_pointer, int64_t column_total,
         // insert
 bool RowTable::insert(char *source)
 {
+    for (unsigned int ii = 0; ii < getColumns().size(); ii++) {
+        if (!inDictionary(ii, source + r_pattern.getColumnOffset(ii)))
+            return false;
+    }
+    r_changes++;
     char *ptr = NULL;
     int64_t rec_id = r_storage.allocRow(ptr);
     if (rec_id< 0) {
@@ -264,11 +317,17 @@ bool RowTable::insert(char *source)
         r_pattern.getColumnType(ii)->copy(ptr + of, source + of);
     }
     ptr[r_pattern.getRowSize() - 1] = 'Y';
+    zoneInsert(rec_id, ptr);
     return true;
 }
 
 bool RowTable::insert(char *columns[])
 {
+    for (unsigned int ii = 0; ii < getColumns().size(); ii++) {
+        if (!inDictionary(ii, columns[ii]))
+            return false;
+    }
+    r_changes++;
     char *ptr = NULL;
     int64_t rec_id = r_storage.allocRow(ptr);
     if (rec_id< 0) {
@@ -280,6 +339,328 @@ bool RowTable::insert(char *columns[])
         r_pattern.getColumnType(ii)->copy(ptr + of, columns[ii]);
     }
     ptr[r_pattern.getRowSize() - 1] = 'Y';
+    zoneInsert(rec_id, ptr);
+    return true;
+}
+
+bool RowTable::inDictionary(int64_t column_rank, char *value)
+{
+    if (r_pattern.getColumnType(column_rank)->getTypeCode() != CHARDICT_TC
+        || (*(int16_t *) value & 1))
+        return true;
+    printf("[RowTable][ERROR][inDictionary]: text not in dictionary of column %ld! -1\n",
+           column_rank);
+    return false;
+}
+
+        // zone map
+void ZoneMap::extend(int64_t block, char *value)
+{
+    int64_t size = type->getTypeSize();
+    if (block >= blocks) {
+        // blocks are filled in record order, a new block starts with its first value
+        min.resize((block + 1) * size);
+        max.resize((block + 1) * size);
+        for (int64_t bb = blocks; bb <= block; bb++) {
+            memcpy(&min[bb * size], value, size);
+            memcpy(&max[bb * size], value, size);
+        }
+        blocks = block + 1;
+        return;
+    }
+    if (type->cmpLT(value, &min[block * size]))
+        memcpy(&min[block * size], value, size);
+    if (type->cmpGT(value, &max[block * size]))
+        memcpy(&max[block * size], value, size);
+}
+
+void RowTable::zoneInsert(int64_t record_rank, char *row_pointer)
+{
+    if (r_zones.empty()) {
+        int64_t num = getColumns().size();
+        r_zones.resize(num);
+        for (int64_t ii = 0; ii < num; ii++) {
+            BasicType *type = r_pattern.getColumnType(ii);
+            if (type->getTypeCode() == CHARN_TC)
+                continue;
+            r_zones[ii].type = type;
+            r_zones[ii].offset = r_pattern.getColumnOffset(ii);
+        }
+    }
+    int64_t block = record_rank / ZONE_ROWS;
+    for (size_t ii = 0; ii < r_zones.size(); ii++) {
+        if (r_zones[ii].type != NULL)
+            r_zones[ii].extend(block, row_pointer + r_zones[ii].offset);
+    }
+    // a block is packed when its last record arrives
+    if ((record_rank + 1) % ZONE_ROWS == 0) {
+        for (size_t ii = 0; ii < r_packed.size(); ii++)
+            packBlock(ii, block);
+    }
+}
+
+void RowTable::zoneUpdate(int64_t record_rank, int64_t column_rank,
+                          char *value)
+{
+    int64_t block = record_rank / ZONE_ROWS;
+    // the block is packed again by repack, not per update
+    if (column_rank < (int64_t) r_packed.size()
+        && block < (int64_t) r_packed[column_rank].blocks.size())
+        r_packed[column_rank].blocks[block].dirty = true;
+    if (column_rank >= (int64_t) r_zones.size()
+        || r_zones[column_rank].type == NULL)
+        return;
+    r_zones[column_rank].extend(block, value);
+}
+
+void RowTable::zoneDrop(int64_t column_rank)
+{
+    if (column_rank >= (int64_t) r_zones.size())
+        return;
+    ZoneMap & zone = r_zones[column_rank];
+    zone.type = NULL;
+    zone.blocks = 0;
+    zone.min.clear();
+    zone.max.clear();
+    // the block of the record is unknown, every block waits for repack
+    if (column_rank < (int64_t) r_packed.size()) {
+        for (size_t ii = 0; ii < r_packed[column_rank].blocks.size(); ii++)
+            r_packed[column_rank].blocks[ii].dirty = true;
+    }
+}
+
+bool RowTable::getZone(int64_t column_rank, int64_t block, char *&min,
+                       char *&max)
+{
+    if (column_rank < 0 || column_rank >= (int64_t) r_zones.size())
+        return false;
+    ZoneMap & zone = r_zones[column_rank];
+    if (zone.type == NULL || block >= zone.blocks)
+        return false;
+    int64_t size = zone.type->getTypeSize();
+    min = &zone.min[block * size];
+    max = &zone.max[block * size];
+    return true;
+}
+
+bool RowTable::packedCompare(int64_t column_rank, int64_t block,
+                             SimdCompare op, char *constant,
+                             uint64_t * mask)
+{
+    if (column_rank < 0 || column_rank >= (int64_t) r_packed.size())
+        return false;
+    return r_packed[column_rank].compare(block, op, constant, mask);
+}
+
+void RowTable::packBlock(int64_t column_rank, int64_t block)
+{
+    PackedColumn & packed = r_packed[column_rank];
+    if (packed.type == NULL)
+        return;
+    int64_t size = packed.type->getTypeSize();
+    std::vector<int64_t> values(ZONE_ROWS);
+    for (int64_t ii = 0; ii < ZONE_ROWS; ii++) {
+        char *value = r_storage.getRow(block * ZONE_ROWS + ii) + packed.offset;
+        switch (size) {
+        case 1:
+            values[ii] = *(int8_t *) value;
+            break;
+        case 2:
+            values[ii] = *(int16_t *) value;
+            break;
+        case 4:
+            values[ii] = *(int32_t *) value;
+            break;
+        default:
+            values[ii] = *(int64_t *) value;
+            break;
+        }
+    }
+    packed.pack(block, values);
+}
+
+bool RowTable::packColumn(int64_t column_rank)
+{
+    if (column_rank < 0 || column_rank >= (int64_t) getColumns().size()) {
+        printf("[RowTable][ERROR][packColumn]: column rank error! -1\n");
+        return false;
+    }
+    BasicType *type = r_pattern.getColumnType(column_rank);
+    TypeCode tc = type->getTypeCode();
+    if (tc == CHARN_TC || tc == FLOAT32_TC || tc == FLOAT64_TC) {
+        printf("[RowTable][ERROR][packColumn]: column %ld can not be packed! -2\n", column_rank);
+        return false;
+    }
+    if ((int64_t) r_packed.size() < (int64_t) getColumns().size())
+        r_packed.resize(getColumns().size());
+    r_packed[column_rank].type = type;
+    r_packed[column_rank].offset = r_pattern.getColumnOffset(column_rank);
+    for (int64_t block = 0; (block + 1) * ZONE_ROWS <= r_storage.getRecordNum(); block++)
+        packBlock(column_rank, block);
+    return true;
+}
+
+void RowTable::repack(void)
+{
+    for (size_t ii = 0; ii < r_packed.size(); ii++) {
+        for (size_t block = 0; block < r_packed[ii].blocks.size(); block++) {
+            if (r_packed[ii].blocks[block].dirty)
+                packBlock(ii, block);
+        }
+    }
+}
+
+int64_t RowTable::getPackedBytes(void)
+{
+    int64_t bytes = 0;
+    for (size_t ii = 0; ii < r_packed.size(); ii++) {
+        for (size_t block = 0; block < r_packed[ii].blocks.size(); block++)
+            bytes += r_packed[ii].blocks[block].bits.size() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+/** number of bits to store an unsigned value */
+static int64_t bitWidth(uint64_t value)
+{
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/** get value i of a block packed in width bits */
+static inline uint64_t unpack(const uint64_t * bits, int64_t ii,
+                              int64_t width)
+{
+    if (width == 0)
+        return 0;
+    int64_t pos = ii * width;
+    int64_t word = pos >> 6, shift = pos & 63;
+    uint64_t value = bits[word] >> shift;
+    if (shift + width > 64)
+        value |= bits[word + 1] << (64 - shift);
+    return width == 64 ? value : value & ((1ULL << width) - 1);
+}
+
+/** set bit i of mask when cmp(offset i in frame, key) */
+template < typename Cmp >
+static void scanFor(const PackedBlock & pb, uint64_t key, Cmp cmp,
+                    uint64_t * mask)
+{
+    const uint64_t *bits = pb.bits.data();
+    for (int64_t ii = 0; ii < ZONE_ROWS; ii++)
+        mask[ii >> 6] |= (uint64_t) cmp(unpack(bits, ii, pb.width), key) << (ii & 63);
+}
+
+/** set bit i of mask when cmp(value i, key), values are decoded by running sum */
+template < typename Cmp >
+static void scanDelta(const PackedBlock & pb, int64_t key, Cmp cmp,
+                      uint64_t * mask)
+{
+    const uint64_t *bits = pb.bits.data();
+    int64_t value = pb.base;
+    for (int64_t ii = 0; ii < ZONE_ROWS; ii++) {
+        value += (int64_t) unpack(bits, ii, pb.width);
+        mask[ii >> 6] |= (uint64_t) cmp(value, key) << (ii & 63);
+    }
+}
+
+void PackedColumn::pack(int64_t block, std::vector<int64_t> &values)
+{
+    if ((int64_t) blocks.size() <= block)
+        blocks.resize(block + 1);
+    PackedBlock & pb = blocks[block];
+    int64_t min = values[0], max = values[0];
+    uint64_t max_delta = 0;
+    bool sorted = true;
+    for (int64_t ii = 1; ii < ZONE_ROWS; ii++) {
+        min = std::min(min, values[ii]);
+        max = std::max(max, values[ii]);
+        if (values[ii] < values[ii - 1])
+            sorted = false;
+        else
+            max_delta = std::max(max_delta, (uint64_t) values[ii] - (uint64_t) values[ii - 1]);
+    }
+    int64_t for_width = bitWidth((uint64_t) max - (uint64_t) min);
+    int64_t delta_width = sorted ? bitWidth(max_delta) : 64;
+    pb.encoding = sorted && delta_width < for_width ? PACK_DELTA : PACK_FOR;
+    pb.width = std::min(for_width, delta_width);
+    pb.base = pb.encoding == PACK_FOR ? min : values[0];
+    pb.dirty = false;
+    if (pb.width > type->getTypeSize() * 4) {
+        // would save less than half, scans read the rows
+        pb.encoding = PACK_NONE;
+        std::vector<uint64_t>().swap(pb.bits);
+        return;
+    }
+    pb.bits.clear();
+    pb.bits.assign((ZONE_ROWS * pb.width + 63) / 64 + 1, 0);
+    for (int64_t ii = 0; ii < ZONE_ROWS; ii++) {
+        uint64_t value = pb.encoding == PACK_FOR
+            ? (uint64_t) values[ii] - (uint64_t) min
+            : (ii == 0 ? 0 : (uint64_t) values[ii] - (uint64_t) values[ii - 1]);
+        if (pb.width == 0)
+            continue;
+        int64_t pos = ii * pb.width;
+        int64_t word = pos >> 6, shift = pos & 63;
+        pb.bits[word] |= value << shift;
+        if (shift + pb.width > 64)
+            pb.bits[word + 1] |= value >> (64 - shift);
+    }
+}
+
+bool PackedColumn::compare(int64_t block, SimdCompare op, char *constant,
+                           uint64_t * mask)
+{
+    if (type == NULL || block >= (int64_t) blocks.size()
+        || blocks[block].encoding == PACK_NONE || blocks[block].dirty)
+        return false;
+    PackedBlock & pb = blocks[block];
+    int64_t key;
+    switch (type->getTypeSize()) {
+    case 1:
+        key = *(int8_t *) constant;
+        break;
+    case 2:
+        key = *(int16_t *) constant;
+        break;
+    case 4:
+        key = *(int32_t *) constant;
+        break;
+    default:
+        key = *(int64_t *) constant;
+        break;
+    }
+    memset(mask, 0, ZONE_ROWS / 64 * sizeof(uint64_t));
+    if (pb.encoding == PACK_DELTA) {
+        switch (op) {
+        case SIMD_LT: scanDelta(pb, key, std::less<int64_t>(), mask); break;
+        case SIMD_LE: scanDelta(pb, key, std::less_equal<int64_t>(), mask); break;
+        case SIMD_EQ: scanDelta(pb, key, std::equal_to<int64_t>(), mask); break;
+        case SIMD_NE: scanDelta(pb, key, std::not_equal_to<int64_t>(), mask); break;
+        case SIMD_GT: scanDelta(pb, key, std::greater<int64_t>(), mask); break;
+        case SIMD_GE: scanDelta(pb, key, std::greater_equal<int64_t>(), mask); break;
+        }
+        return true;
+    }
+    // compare offsets in the frame, a constant outside the frame passes all or none
+    uint64_t top = pb.width == 64 ? ~0ULL : (1ULL << pb.width) - 1;
+    bool below = key < pb.base;
+    bool above = !below && (uint64_t) key - (uint64_t) pb.base > top;
+    if (below || above) {
+        bool pass = op == SIMD_NE || (below ? (op == SIMD_GT || op == SIMD_GE)
+                                            : (op == SIMD_LT || op == SIMD_LE));
+        if (pass)
+            memset(mask, 0xff, ZONE_ROWS / 64 * sizeof(uint64_t));
+        return true;
+    }
+    uint64_t offset = (uint64_t) key - (uint64_t) pb.base;
+    switch (op) {
+    case SIMD_LT: scanFor(pb, offset, std::less<uint64_t>(), mask); break;
+    case SIMD_LE: scanFor(pb, offset, std::less_equal<uint64_t>(), mask); break;
+    case SIMD_EQ: scanFor(pb, offset, std::equal_to<uint64_t>(), mask); break;
+    case SIMD_NE: scanFor(pb, offset, std::not_equal_to<uint64_t>(), mask); break;
+    case SIMD_GT: scanFor(pb, offset, std::greater<uint64_t>(), mask); break;
+    case SIMD_GE: scanFor(pb, offset, std::greater_equal<uint64_t>(), mask); break;
+    }
     return true;
 }
 
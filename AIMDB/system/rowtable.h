@@ -21,9 +21,12 @@
 
 #include "mymemory.h"
 #include "schema.h"
+#include "simd.h"
 
 extern Memory g_memory;
 
+#define ZONE_ROWS (1024)  /**< records summarized by one zone map block */
+
 /** definition of class RPattern, describe row struture. */
 class RPattern {
   private:
@@ -242,6 +245,18 @@ class MStorage {
     int64_t getRecordNum(void) {
         return ms_record_num;
     }
+    /**
+     * get slot pointers, record r is at slot r / getRecordPerSlot()
+     */
+    char **getSlots(void) {
+        return ms_slots_point;
+    }
+    /**
+     * get number of records stored in a slot.
+     */
+    int64_t getRecordPerSlot(void) {
+        return ms_record_per_slot;
+    }
   private:
     /**
      * expand slots for more storage avaliable for this table.
@@ -273,11 +288,79 @@ class MStorage {
     }
 };  // class MStorage
 
+/**
+ * definition of ZoneMap, min and max of one numeric or date column per block of ZONE_ROWS records.
+ * block b covers records [b * ZONE_ROWS, (b + 1) * ZONE_ROWS), ranges only widen:
+ * deleted records stay counted, so a block range may be looser than its valid records.
+ */
+class ZoneMap {
+  public:
+    BasicType *type = NULL;     /**< column type, NULL if the column has no zone map  */
+    int64_t offset = 0;         /**< offset of column in a row                        */
+    int64_t blocks = 0;         /**< blocks summarized, blocks after them are unknown */
+    std::vector<char> min;      /**< minimum of each block, type size per block       */
+    std::vector<char> max;      /**< maximum of each block, type size per block       */
+    /**
+     * widen range of a block to include a value.
+     * @param block the n th block of the table
+     * @param value value of the column
+     */
+    void extend(int64_t block, char *value);
+};  // class ZoneMap
+
+/** encoding of a block of a packed column. */
+enum PackEncoding {
+    PACK_NONE = 0,  /**< not packed, values are read from rows              */
+    PACK_FOR,       /**< frame of reference, value - base in width bits     */
+    PACK_DELTA      /**< non-decreasing values, value - previous value      */
+};
+
+/** definition of PackedBlock, values of ZONE_ROWS records packed in width bits each. */
+struct PackedBlock {
+    PackEncoding encoding = PACK_NONE;  /**< encoding of the block                         */
+    int64_t base = 0;                   /**< minimum for FOR, first value for DELTA        */
+    int64_t width = 0;                  /**< bits per value, 0 if nothing to store         */
+    std::vector<uint64_t> bits;         /**< packed values, value i starts at bit i*width  */
+    bool dirty = false;                 /**< rows changed since packing, read the rows     */
+};
+
+/**
+ * definition of PackedColumn, a compressed copy of an integer, date or dictionary column per full block,
+ * kept only for columns asked for by RowTable::packColumn, rows stay as they are.
+ * encoding is chosen per block and a block is packed only if it takes at most half the bits.
+ * predicates are evaluated on packed values without reading the rows.
+ */
+class PackedColumn {
+  public:
+    BasicType *type = NULL;             /**< column type, NULL if the column is not packed */
+    int64_t offset = 0;                 /**< offset of column in a row                     */
+    std::vector<PackedBlock> blocks;    /**< one per full block of ZONE_ROWS records       */
+    /**
+     * pack values of a block.
+     * @param block  the n th block of the table
+     * @param values ZONE_ROWS values of the column
+     */
+    void pack(int64_t block, std::vector<int64_t> &values);
+    /**
+     * compare values of a packed block against a constant.
+     * @param  block    the n th block of the table
+     * @param  op       compare method
+     * @param  constant constant of column type
+     * @param  mask     ZONE_ROWS/64 words, bit i is set if record i of block passes
+     * @retval true     success
+     * @retval false    block not packed, or dirty
+     */
+    bool compare(int64_t block, SimdCompare op, char *constant, uint64_t *mask);
+};  // class PackedColumn
+
 /** definition of class RowTable.  */
 class RowTable:public Table {
   private:
     RPattern r_pattern;  /**< pattern of row  */
     MStorage r_storage;  /**< storage of table  */
+    std::vector<ZoneMap> r_zones;  /**< zone map of each column, built on first insert  */
+    std::vector<PackedColumn> r_packed;  /**< packed copy of columns asked for by packColumn  */
+    int64_t r_changes = 0;         /**< records inserted, updated or deleted so far  */
   public:
     /**
      * constructor.
@@ -491,6 +574,12 @@ class RowTable:public Table {
     int64_t getRecordNum(void) {
         return r_storage.getRecordNum();
     }
+    /**
+     * get number of records inserted, updated or deleted, it only grows.
+     */
+    int64_t getChangeNum(void) {
+        return r_changes;
+    }
     /**
      * get row record pointer.
      * @param  row_rank the n th record in thetable
@@ -501,8 +590,80 @@ class RowTable:public Table {
         char *ptr = NULL;
         return access(row_rank, ptr) ? ptr : NULL;
     }
+    /**
+     * get min and max of a column over a block of ZONE_ROWS records.
+     * @param  column_rank the n th column in table pattern
+     * @param  block       the n th block, records from block * ZONE_ROWS
+     * @param  min         result pointer to minimum
+     * @param  max         result pointer to maximum
+     * @retval true        success
+     * @retval false       no zone map for the column or the block, every value is possible
+     */
+    bool getZone(int64_t column_rank, int64_t block, char *&min, char *&max);
+    /**
+     * compare a column over a block of ZONE_ROWS records against a constant, on packed values.
+     * @param  column_rank the n th column in table pattern
+     * @param  block       the n th block, records from block * ZONE_ROWS
+     * @param  op          compare method
+     * @param  constant    constant of column type
+     * @param  mask        ZONE_ROWS/64 words, bit i is set if record i of block passes
+     * @retval true        success, deleted records are not excluded
+     * @retval false       the block of the column is not packed, or changed since packing
+     */
+    bool packedCompare(int64_t column_rank, int64_t block, SimdCompare op,
+                       char *constant, uint64_t *mask);
+    /**
+     * keep a packed copy of a column, full blocks are packed now and as they fill up.
+     * the copy costs memory besides the rows, see getPackedBytes.
+     * @param  column_rank the n th column in table pattern
+     * @retval true        success
+     * @retval false       column is not an integer, date or dictionary column
+     */
+    bool packColumn(int64_t column_rank);
+    /**
+     * pack again blocks changed since they were packed, until then scans read their rows.
+     */
+    void repack(void);
+    /**
+     * get memory of packed copies.
+     * @retval bytes of packed values of all columns
+     */
+    int64_t getPackedBytes(void);
 
   private:
+    /**
+     * check a value for a dictionary column, its dictionary is fixed at load, see TypeCharDict.
+     * @param  column_rank the n th column in table pattern
+     * @param  value       binary value of column type
+     * @retval true        not a dictionary column, or a code of a text in the dictionary
+     * @retval false       an even code, the text is not in the dictionary and would be lost
+     */
+    bool inDictionary(int64_t column_rank, char *value);
+    /**
+     * add a new record to zone maps, zone maps of numeric and date columns are built on first call.
+     * @param record_rank the n th record in the table
+     * @param row_pointer the pointer of the record
+     */
+    void zoneInsert(int64_t record_rank, char *row_pointer);
+    /**
+     * widen zone map of a column to include a new value of a record.
+     * @param record_rank the n th record in the table
+     * @param column_rank the n th column in table pattern
+     * @param value       new value of the column
+     */
+    void zoneUpdate(int64_t record_rank, int64_t column_rank, char *value);
+    /**
+     * drop zone map of a column, when a value is changed through a row pointer
+     * the block of the record is unknown.
+     * @param column_rank the n th column in table pattern
+     */
+    void zoneDrop(int64_t column_rank);
+    /**
+     * pack a full block of a column from its rows.
+     * @param column_rank the n th column in table pattern
+     * @param block       the n th block of the table
+     */
+    void packBlock(int64_t column_rank, int64_t block);
     /**
      * get a row record pointer.
      * @param  record_rank the n th record in the table
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
+#include <set>
 
 const char *table_name[] = {
     "part",
@@ -30,6 +31,7 @@ int load_schema(const char *filename);
 int load_data(const char *tablename[],const char *data_dir, int number);
 int test(void);
 int testOne (int which);
+int testGroupInsert (void);
 
 int main(int argc, char *argv[])
 {
@@ -77,6 +79,7 @@ int main(int argc, char *argv[])
  * (1) split by one '\t', a row ends with '\n'
  * (2) claim Database,Table,column,index in order
  * (3) no empty row
+ * (4) a column row may end with PACKED, to keep a packed copy of an integer, date or dictionary column
 **/
 int load_schema(const char *filename)
 {
@@ -171,6 +174,9 @@ int load_schema(const char *filename)
             g_catalog.createColumn((const char *) row[1], type, len,
                                    cur_col_id);
             cur_tb_ptr->addColumn(cur_col_id);
+            // optional last field PACKED asks for a packed copy of the column
+            if (num > (type == CHARN ? 4 : 3) && !strcmp(row[num - 1], "PACKED"))
+                ((Column *) g_catalog.getObjById(cur_col_id))->setPacked();
         } else if (!strcmp(row[0], "INDEX")) {
             IndexType type = INVID_I;
             std::vector < int64_t > cols;
@@ -199,6 +205,84 @@ int load_schema(const char *filename)
     return 0;
 }
 
+/**
+ * split a row of a data file into columns, in place
+ * @param buffer  one row, ends with '\n'
+ * @param columns returns the start of each column
+ * @param colnum  number of columns
+ */
+static void split_row(char *buffer, char *columns[], int64_t colnum)
+{
+    columns[0] = buffer;
+    int64_t pos = 0;
+    for (int64_t ii = 1; ii < colnum; ii++) {
+        for (int64_t jj = 0; jj < 2048; jj++) {
+            if (buffer[pos] == '\t') {
+                buffer[pos] = '\0';
+                columns[ii] = buffer + pos + 1;
+                pos++;
+                break;
+            } else
+                pos++;
+        }
+    }
+    while (buffer[pos] != '\n' && buffer[pos] != '\0')
+        pos++;
+    buffer[pos] = '\0';
+}
+
+/**
+ * read a data file once and dictionary encode the CHARN columns of its table that have
+ * at most DICT_MAX_VALUES distinct values, columns of an index key keep their text
+ * @param tp table to load, still empty
+ * @param fp data file, rewound when done
+ * @retval 0  success
+ * @retval <0 faliure
+ */
+static int encode_dictionaries(Table *tp, FILE *fp)
+{
+    std::vector < int64_t > &cols = tp->getColumns();
+    int64_t colnum = cols.size();
+    std::vector < std::set < std::string > > distinct(colnum);
+    std::vector < int64_t > width(colnum, 0);
+    bool any = false;
+    for (int64_t ii = 0; ii < colnum; ii++) {
+        BasicType *type = ((Column *) g_catalog.getObjById(cols[ii]))->getDataType();
+        // codes are int16, a narrower text is not worth a dictionary
+        if (type->getTypeCode() == CHARN_TC && type->getTypeSize() >= (int64_t) sizeof(int16_t)) {
+            width[ii] = type->getTypeSize();
+            any = true;
+        }
+    }
+    for (unsigned int ii = 0; ii < tp->getIndexs().size(); ii++) {
+        Index *index = (Index *) g_catalog.getObjById(tp->getIndexs()[ii]);
+        for (unsigned int jj = 0; jj < index->getIKey().getKey().size(); jj++)
+            width[tp->getColumnRank(index->getIKey().getKey()[jj])] = 0;
+    }
+    if (!any)
+        return 0;
+
+    char buffer[2048];
+    char *columns[colnum];
+    while (fgets(buffer, 2048, fp)) {
+        split_row(buffer, columns, colnum);
+        for (int64_t ii = 0; ii < colnum; ii++) {
+            if (width[ii] == 0)
+                continue;
+            distinct[ii].insert(std::string(columns[ii], strnlen(columns[ii], width[ii])));
+            if (distinct[ii].size() > DICT_MAX_VALUES) {
+                width[ii] = 0;
+                distinct[ii].clear();
+            }
+        }
+    }
+    rewind(fp);
+    std::vector < std::vector < std::string > > values(colnum);
+    for (int64_t ii = 0; ii < colnum; ii++)
+        values[ii].assign(distinct[ii].begin(), distinct[ii].end());
+    return g_catalog.encodeTable(tp->getOid(), values) ? 0 : -1;
+}
+
 /**
  * load table data from txt files
  * @param tablename names of tables
@@ -235,6 +319,10 @@ int load_data(const char *tablename[],const char *data_dir, int number)
             printf("[load_data][ERROR]: tablename error!\n");
             return -2;
         }
+        if (encode_dictionaries(tp, fp)) {
+            printf("[load_data][ERROR]: dictionary encode error!\n");
+            return -4;
+        }
         int colnum = tp->getColumns().size();
         BasicType *dtype[colnum];
         for (int ii = 0; ii < colnum; ii++)
@@ -253,29 +341,7 @@ int load_data(const char *tablename[],const char *data_dir, int number)
         char data[colnum][1024];
         while (fgets(buffer, 2048, fp)) {
             // insert table
-            columns[0] = buffer;
-            int64_t pos = 0;
-            for (int64_t ii = 1; ii < colnum; ii++) {
-                for (int64_t jj = 0; jj < 2048; jj++) {
-                    if (buffer[pos] == '\t') {
-                        buffer[pos] = '\0';
-                        columns[ii] = buffer + pos + 1;
-                        pos++;
-                        break;
-                    } else
-                        pos++;
-                }
-            }
-            /*
-               // debug
-               for (int ii= 0; ii< colnum; ii++) {
-               printf ("%s\t", columns[ii]);
-               }
-               printf ("\n");
-             */
-            while (buffer[pos] != '\n')
-                pos++;
-            buffer[pos] = '\0';
+            split_row(buffer, columns, colnum);
             for (int64_t ii = 0; ii < colnum; ii++) {
                 BasicType *p = dtype[ii];
                 p->formatBin(data[ii], columns[ii]);
@@ -295,6 +361,25 @@ int load_data(const char *tablename[],const char *data_dir, int number)
         }
         if (print_flag)
             tp->printData();
+        // a column that can not be packed is only reported, its scans read the rows
+        for (int ii = 0; ii < colnum; ii++) {
+            if (((Column *) g_catalog.getObjById(tp->getColumns()[ii]))->isPacked())
+                ((RowTable *) tp)->packColumn(ii);
+        }
+        if (print_flag)
+            printf("%s packed bytes: %ld\n", tp->getOname(), ((RowTable *) tp)->getPackedBytes());
+        // statistics for the planner
+        if (g_catalog.analyzeTable(tp->getOid()) == false) {
+            printf("[load_data][ERROR]: analyze table error!\n");
+            return -3;
+        }
+        if (print_flag) {
+            for (unsigned int ii = 0; ii < tp->getColumns().size(); ii++) {
+                int64_t c_id = tp->getColumns()[ii];
+                printf("%s: ", g_catalog.getObjById(c_id)->getOname());
+                g_catalog.getColumnStats(c_id)->print();
+            }
+        }
     }
     return 0;
 }
@@ -752,6 +837,7 @@ int test (void) {
     for (int ii =0; ii< 14;ii++) {
         testOne (tq_num[ii]);
     }
+    testGroupInsert ();
     return 0;
 }
 
@@ -774,9 +860,12 @@ int testOne (int which)
     }
     ResultTable result = {};
     int stat = executor.exec(&querys[which-1], &result);
+    std::vector<char> text;
     while (stat > 0) {
-        result.print ();
-        result.dump  (fp);
+        // a batch is formatted once, then printed and dumped
+        result.format (text);
+        fwrite (text.data(), 1, text.size(), stdout);
+        fwrite (text.data(), 1, text.size(), fp);
         stat = executor.exec(NULL, &result);
     }
     fprintf(fp,"\n");
@@ -784,3 +873,56 @@ int testOne (int which)
     result.shut ();
     return 0;
 }
+
+/**
+ * check that rows inserted after analyze with a new group key reach GROUP BY output,
+ * their key is out of the range of the statistics and their count is too small to renew them.
+ * @retval 0  success
+ * @retval <0 failure
+ */
+int testGroupInsert (void)
+{
+    const int32_t new_key = 1000;
+    const int64_t new_rows = 3;
+    RowTable *table = (RowTable *) g_catalog.getObjByName ((char *) "lineitem");
+    Object *column = g_catalog.getObjByName ((char *) "l_linenumber");
+    if (table == NULL || column == NULL || table->getRecordNum () == 0)
+        return 0;
+    int64_t column_rank = table->getColumnRank (column->getOid ());
+    RPattern &pattern = table->getRPattern ();
+    std::vector<char> row (table->getMStorage ().getRow (0), table->getMStorage ().getRow (0) + pattern.getRowSize ());
+    memcpy (&row[pattern.getColumnOffset (column_rank)], &new_key, sizeof (new_key));
+    for (int64_t ii = 0; ii < new_rows; ii++)
+        table->insert (row.data ());
+
+    // select l_linenumber,count(l_orderkey) from lineitem group by l_linenumber
+    SelectQuery query = {
+        1,
+        2, {{"l_linenumber",NONE_AM}, {"l_orderkey",COUNT}},
+        1, {"lineitem"},
+        {0, {}},
+        1, {{"l_linenumber",NONE_AM}},
+        {0, {}},
+        0, {}, 0
+    };
+    Executor executor;
+    ResultTable result = {};
+    int64_t found = -1;
+    for (int stat = executor.exec (&query, &result); stat > 0; stat = executor.exec (NULL, &result)) {
+        for (int ii = 0; ii < result.row_number; ii++) {
+            if (*(int32_t *) result.get_RC (ii, 0) == new_key)
+                found = *(int64_t *) result.get_RC (ii, 1);
+        }
+    }
+    result.shut ();
+    for (int64_t ii = 0; ii < new_rows; ii++)
+        table->del (table->getRecordNum () - 1 - ii);
+    if (found != new_rows) {
+        printf ("[runaimdb][ERROR][testGroupInsert]: group %d counts %ld rows, %ld inserted!\n",
+                new_key, found, new_rows);
+        return -1;
+    }
+    if (print_flag)
+        printf ("group of inserted rows found!\n");
+    return 0;
+}
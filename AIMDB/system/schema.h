@@ -147,6 +147,7 @@ class Column:public Object {
     ColumnType c_type;     /**< column type */
     int64_t c_size;        /**< column size */
     BasicType *c_datatype; /**< column data type */
+    bool c_packed = false; /**< keep a packed copy of the column, see RowTable::packColumn */
   public:
     /**
      * constructor.
@@ -251,6 +252,33 @@ class Column:public Object {
     BasicType *getDataType(void) {
         return c_datatype;
     }
+    /**
+     * store a CHARN column as codes of an order-preserving dictionary
+     * @param values distinct values of the column
+     * @retval true  success
+     * @retval false not a CHARN column
+     */
+    bool setDictionary(const std::vector < std::string > &values) {
+        if (c_type != CHARN || c_datatype == NULL
+            || c_datatype->getTypeCode() != CHARN_TC)
+            return false;
+        BasicType *dict = new TypeCharDict(c_datatype->getTypeSize(), values);
+        delete c_datatype;
+        c_datatype = dict;
+        return true;
+    }
+    /**
+     * ask for a packed copy of the column, made when the table is loaded
+     */
+    void setPacked(void) {
+        c_packed = true;
+    }
+    /**
+     * whether a packed copy of the column is asked for
+     */
+    bool isPacked(void) {
+        return c_packed;
+    }
     // HACK, if you want to implement COLTABLE, then add code here, now is for ROWTABLE
 };  // class Column
 
@@ -0,0 +1,251 @@
+/**
+ * @file    simd.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  SIMD kernels comparing a column vector against a constant.
+ *  each instruction set gets its own functions compiled with target attributes,
+ *  so the system builds without -mavx2 and still uses AVX2 / AVX-512 when the cpu has them.
+ *  only LT, EQ and GT are computed, LE, NE and GE are their negation.
+ *
+ */
+
+#include <string.h>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/** compares computed by kernels. */
+enum BaseCompare {
+    BASE_LT = 0,
+    BASE_EQ,
+    BASE_GT
+};
+
+/**
+ * compare values [from, num) one by one
+ */
+template <typename T>
+static void scalar_compare(const T *data, int64_t from, int64_t num, BaseCompare op, T c, uint64_t *mask)
+{
+    for (int64_t ii = from; ii < num; ii++) {
+        bool pass = op == BASE_LT ? data[ii] < c : (op == BASE_EQ ? data[ii] == c : data[ii] > c);
+        mask[ii >> 6] |= (uint64_t) pass << (ii & 63);
+    }
+}
+
+template <typename T>
+static void scalar_kernel(const T *data, int64_t num, BaseCompare op, T c, uint64_t *mask)
+{
+    scalar_compare(data, 0, num, op, c, mask);
+}
+
+#ifdef SIMD_X86
+/**
+ * define a kernel, WIDTH values are compared by one instruction and give WIDTH bits,
+ * WIDTH divides 64 so the bits never straddle two mask words
+ */
+#define SIMD_KERNEL(name, isa, T, VEC, WIDTH, SET1, LOAD, LT, EQ, GT, MASK)          \
+__attribute__((target(isa)))                                                        \
+static void name(const T *data, int64_t num, BaseCompare op, T c, uint64_t *mask)   \
+{                                                                                   \
+    VEC vc = SET1(c);                                                               \
+    int64_t ii = 0;                                                                 \
+    for (; ii + WIDTH <= num; ii += WIDTH) {                                        \
+        VEC v = LOAD(data + ii);                                                    \
+        uint64_t bits;                                                              \
+        if (op == BASE_LT)                                                          \
+            bits = MASK(LT(v, vc));                                                 \
+        else if (op == BASE_EQ)                                                     \
+            bits = MASK(EQ(v, vc));                                                 \
+        else                                                                        \
+            bits = MASK(GT(v, vc));                                                 \
+        mask[ii >> 6] |= bits << (ii & 63);                                         \
+    }                                                                               \
+    scalar_compare(data, ii, num, op, c, mask);                                     \
+}
+
+// SSE2, 128 bits
+#define SSE_LOADI(p)        _mm_loadu_si128((const __m128i *) (p))
+#define SSE_LT8(a, b)       _mm_cmplt_epi8(a, b)
+#define SSE_EQ8(a, b)       _mm_cmpeq_epi8(a, b)
+#define SSE_GT8(a, b)       _mm_cmpgt_epi8(a, b)
+#define SSE_LT16(a, b)      _mm_cmplt_epi16(a, b)
+#define SSE_EQ16(a, b)      _mm_cmpeq_epi16(a, b)
+#define SSE_GT16(a, b)      _mm_cmpgt_epi16(a, b)
+#define SSE_LT32(a, b)      _mm_cmplt_epi32(a, b)
+#define SSE_EQ32(a, b)      _mm_cmpeq_epi32(a, b)
+#define SSE_GT32(a, b)      _mm_cmpgt_epi32(a, b)
+#define SSE_MASK8(x)        (uint64_t) (uint32_t) _mm_movemask_epi8(x)
+#define SSE_MASK16(x)       (uint64_t) ((uint32_t) _mm_movemask_epi8(_mm_packs_epi16(x, _mm_setzero_si128())) & 0xFF)
+#define SSE_MASK32(x)       (uint64_t) (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(x))
+#define SSE_MASKPS(x)       (uint64_t) (uint32_t) _mm_movemask_ps(x)
+#define SSE_MASKPD(x)       (uint64_t) (uint32_t) _mm_movemask_pd(x)
+SIMD_KERNEL(sse2_i8,  "sse2", int8_t,  __m128i, 16, _mm_set1_epi8,  SSE_LOADI, SSE_LT8,  SSE_EQ8,  SSE_GT8,  SSE_MASK8)
+SIMD_KERNEL(sse2_i16, "sse2", int16_t, __m128i, 8,  _mm_set1_epi16, SSE_LOADI, SSE_LT16, SSE_EQ16, SSE_GT16, SSE_MASK16)
+SIMD_KERNEL(sse2_i32, "sse2", int32_t, __m128i, 4,  _mm_set1_epi32, SSE_LOADI, SSE_LT32, SSE_EQ32, SSE_GT32, SSE_MASK32)
+SIMD_KERNEL(sse2_f32, "sse2", float,   __m128,  4,  _mm_set1_ps,    _mm_loadu_ps, _mm_cmplt_ps, _mm_cmpeq_ps, _mm_cmpgt_ps, SSE_MASKPS)
+SIMD_KERNEL(sse2_f64, "sse2", double,  __m128d, 2,  _mm_set1_pd,    _mm_loadu_pd, _mm_cmplt_pd, _mm_cmpeq_pd, _mm_cmpgt_pd, SSE_MASKPD)
+
+/** SSE2 has no 64 bits integer compare */
+static void sse2_i64(const int64_t *data, int64_t num, BaseCompare op, int64_t c, uint64_t *mask)
+{
+    scalar_compare(data, 0, num, op, c, mask);
+}
+
+// AVX2, 256 bits
+#define AVX_LOADI(p)        _mm256_loadu_si256((const __m256i *) (p))
+#define AVX_LT8(a, b)       _mm256_cmpgt_epi8(b, a)
+#define AVX_EQ8(a, b)       _mm256_cmpeq_epi8(a, b)
+#define AVX_GT8(a, b)       _mm256_cmpgt_epi8(a, b)
+#define AVX_LT16(a, b)      _mm256_cmpgt_epi16(b, a)
+#define AVX_EQ16(a, b)      _mm256_cmpeq_epi16(a, b)
+#define AVX_GT16(a, b)      _mm256_cmpgt_epi16(a, b)
+#define AVX_LT32(a, b)      _mm256_cmpgt_epi32(b, a)
+#define AVX_EQ32(a, b)      _mm256_cmpeq_epi32(a, b)
+#define AVX_GT32(a, b)      _mm256_cmpgt_epi32(a, b)
+#define AVX_LT64(a, b)      _mm256_cmpgt_epi64(b, a)
+#define AVX_EQ64(a, b)      _mm256_cmpeq_epi64(a, b)
+#define AVX_GT64(a, b)      _mm256_cmpgt_epi64(a, b)
+#define AVX_LTPS(a, b)      _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define AVX_EQPS(a, b)      _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#define AVX_GTPS(a, b)      _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define AVX_LTPD(a, b)      _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define AVX_EQPD(a, b)      _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define AVX_GTPD(a, b)      _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define AVX_MASK8(x)        (uint64_t) (uint32_t) _mm256_movemask_epi8(x)
+// packs works inside 128 bits lanes, permute puts the 16 packed bytes together
+#define AVX_MASK16(x)       (uint64_t) ((uint32_t) _mm256_movemask_epi8(_mm256_permute4x64_epi64( \
+                                _mm256_packs_epi16(x, _mm256_setzero_si256()), 0xD8)) & 0xFFFF)
+#define AVX_MASK32(x)       (uint64_t) (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(x))
+#define AVX_MASK64(x)       (uint64_t) (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(x))
+#define AVX_MASKPS(x)       (uint64_t) (uint32_t) _mm256_movemask_ps(x)
+#define AVX_MASKPD(x)       (uint64_t) (uint32_t) _mm256_movemask_pd(x)
+SIMD_KERNEL(avx2_i8,  "avx2", int8_t,  __m256i, 32, _mm256_set1_epi8,   AVX_LOADI, AVX_LT8,  AVX_EQ8,  AVX_GT8,  AVX_MASK8)
+SIMD_KERNEL(avx2_i16, "avx2", int16_t, __m256i, 16, _mm256_set1_epi16,  AVX_LOADI, AVX_LT16, AVX_EQ16, AVX_GT16, AVX_MASK16)
+SIMD_KERNEL(avx2_i32, "avx2", int32_t, __m256i, 8,  _mm256_set1_epi32,  AVX_LOADI, AVX_LT32, AVX_EQ32, AVX_GT32, AVX_MASK32)
+SIMD_KERNEL(avx2_i64, "avx2", int64_t, __m256i, 4,  _mm256_set1_epi64x, AVX_LOADI, AVX_LT64, AVX_EQ64, AVX_GT64, AVX_MASK64)
+SIMD_KERNEL(avx2_f32, "avx2", float,   __m256,  8,  _mm256_set1_ps, _mm256_loadu_ps, AVX_LTPS, AVX_EQPS, AVX_GTPS, AVX_MASKPS)
+SIMD_KERNEL(avx2_f64, "avx2", double,  __m256d, 4,  _mm256_set1_pd, _mm256_loadu_pd, AVX_LTPD, AVX_EQPD, AVX_GTPD, AVX_MASKPD)
+
+// AVX-512, 512 bits, compares give a mask register directly
+#define AVX512_LOADI(p)     _mm512_loadu_si512((const void *) (p))
+#define AVX512_LT8(a, b)    _mm512_cmp_epi8_mask(a, b, _MM_CMPINT_LT)
+#define AVX512_EQ8(a, b)    _mm512_cmp_epi8_mask(a, b, _MM_CMPINT_EQ)
+#define AVX512_GT8(a, b)    _mm512_cmp_epi8_mask(a, b, _MM_CMPINT_NLE)
+#define AVX512_LT16(a, b)   _mm512_cmp_epi16_mask(a, b, _MM_CMPINT_LT)
+#define AVX512_EQ16(a, b)   _mm512_cmp_epi16_mask(a, b, _MM_CMPINT_EQ)
+#define AVX512_GT16(a, b)   _mm512_cmp_epi16_mask(a, b, _MM_CMPINT_NLE)
+#define AVX512_LT32(a, b)   _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_LT)
+#define AVX512_EQ32(a, b)   _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_EQ)
+#define AVX512_GT32(a, b)   _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NLE)
+#define AVX512_LT64(a, b)   _mm512_cmp_epi64_mask(a, b, _MM_CMPINT_LT)
+#define AVX512_EQ64(a, b)   _mm512_cmp_epi64_mask(a, b, _MM_CMPINT_EQ)
+#define AVX512_GT64(a, b)   _mm512_cmp_epi64_mask(a, b, _MM_CMPINT_NLE)
+#define AVX512_LTPS(a, b)   _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define AVX512_EQPS(a, b)   _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ)
+#define AVX512_GTPS(a, b)   _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define AVX512_LTPD(a, b)   _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ)
+#define AVX512_EQPD(a, b)   _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ)
+#define AVX512_GTPD(a, b)   _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)
+#define AVX512_MASK(x)      (uint64_t) (x)
+SIMD_KERNEL(avx512_i8,  "avx512f,avx512bw", int8_t,  __m512i, 64, _mm512_set1_epi8,  AVX512_LOADI, AVX512_LT8,  AVX512_EQ8,  AVX512_GT8,  AVX512_MASK)
+SIMD_KERNEL(avx512_i16, "avx512f,avx512bw", int16_t, __m512i, 32, _mm512_set1_epi16, AVX512_LOADI, AVX512_LT16, AVX512_EQ16, AVX512_GT16, AVX512_MASK)
+SIMD_KERNEL(avx512_i32, "avx512f,avx512bw", int32_t, __m512i, 16, _mm512_set1_epi32, AVX512_LOADI, AVX512_LT32, AVX512_EQ32, AVX512_GT32, AVX512_MASK)
+SIMD_KERNEL(avx512_i64, "avx512f,avx512bw", int64_t, __m512i, 8,  _mm512_set1_epi64, AVX512_LOADI, AVX512_LT64, AVX512_EQ64, AVX512_GT64, AVX512_MASK)
+SIMD_KERNEL(avx512_f32, "avx512f,avx512bw", float,   __m512,  16, _mm512_set1_ps, _mm512_loadu_ps, AVX512_LTPS, AVX512_EQPS, AVX512_GTPS, AVX512_MASK)
+SIMD_KERNEL(avx512_f64, "avx512f,avx512bw", double,  __m512d, 8,  _mm512_set1_pd, _mm512_loadu_pd, AVX512_LTPD, AVX512_EQPD, AVX512_GTPD, AVX512_MASK)
+
+#define SIMD_CHOOSE(T, suffix) (level == SIMD_AVX512 ? avx512_##suffix :  \
+                                level == SIMD_AVX2   ? avx2_##suffix   :  \
+                                level == SIMD_SSE2   ? sse2_##suffix   : scalar_kernel<T>)
+#else
+#define SIMD_CHOOSE(T, suffix) (scalar_kernel<T>)
+#endif   /* SIMD_X86 */
+
+static SimdLevel simd_detect(void)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel simd_level(void)
+{
+    static SimdLevel level = simd_detect();
+    return level;
+}
+
+/**
+ * run a kernel, then negate the mask for LE, NE and GE
+ */
+template <typename T>
+static void simd_run(void (*kernel)(const T *, int64_t, BaseCompare, T, uint64_t *),
+                     const void *data, int64_t num, SimdCompare op, const void *constant, uint64_t *mask)
+{
+    T c;
+    memcpy(&c, constant, sizeof(T));
+    int64_t words = (num + 63) >> 6;
+    memset(mask, 0, words * sizeof(uint64_t));
+    BaseCompare base;
+    if (op == SIMD_LT || op == SIMD_GE)
+        base = BASE_LT;
+    else if (op == SIMD_EQ || op == SIMD_NE)
+        base = BASE_EQ;
+    else
+        base = BASE_GT;
+    kernel((const T *) data, num, base, c, mask);
+    if (op == SIMD_LE || op == SIMD_NE || op == SIMD_GE) {
+        for (int64_t ii = 0; ii < words; ii++)
+            mask[ii] = ~mask[ii];
+        if (num & 63)
+            mask[words - 1] &= (1ULL << (num & 63)) - 1;
+    }
+}
+
+bool simd_compare(TypeCode type, const void *data, int64_t num, SimdCompare op,
+                  const void *constant, uint64_t *mask)
+{
+    SimdLevel level = simd_level();
+    (void) level;
+    switch (type) {
+    case INT8_TC:
+        simd_run<int8_t>(SIMD_CHOOSE(int8_t, i8), data, num, op, constant, mask);
+        return true;
+    case INT16_TC:
+    case CHARDICT_TC:   // order-preserving int16 codes
+        simd_run<int16_t>(SIMD_CHOOSE(int16_t, i16), data, num, op, constant, mask);
+        return true;
+    case INT32_TC:
+        simd_run<int32_t>(SIMD_CHOOSE(int32_t, i32), data, num, op, constant, mask);
+        return true;
+    case INT64_TC:
+    case DATE_TC:       // stored as time_t
+    case TIME_TC:
+    case DATETIME_TC:
+        if (sizeof(time_t) != sizeof(int64_t))
+            return false;
+        simd_run<int64_t>(SIMD_CHOOSE(int64_t, i64), data, num, op, constant, mask);
+        return true;
+    case FLOAT32_TC:
+        simd_run<float>(SIMD_CHOOSE(float, f32), data, num, op, constant, mask);
+        return true;
+    case FLOAT64_TC:
+        simd_run<double>(SIMD_CHOOSE(double, f64), data, num, op, constant, mask);
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * @file    simd.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  SIMD kernels comparing a column vector against a constant.
+ *
+ *  @basic usage:
+ *
+ *  (1) copy values of a column into a contiguous vector.
+ *  (2) call simd_compare, it sets bit i of mask when value i satisfies the comparison.
+ *  (3) the kernel is chosen once at runtime: AVX-512, AVX2, SSE2 or plain C++.
+ *
+ */
+
+#ifndef _SIMD_H
+#define _SIMD_H
+
+#include <stdint.h>
+#include "datatype.h"
+
+/** compare of a kernel, value <op> constant. */
+enum SimdCompare {
+    SIMD_LT = 0,  /**< less than */
+    SIMD_LE,      /**< less than or equal to */
+    SIMD_EQ,      /**< equal to */
+    SIMD_NE,      /**< not equal to */
+    SIMD_GT,      /**< greater than */
+    SIMD_GE       /**< greater than or equal to */
+};
+
+/** instruction set used by kernels. */
+enum SimdLevel {
+    SIMD_SCALAR = 0,  /**< plain C++ */
+    SIMD_SSE2,        /**< 128 bits */
+    SIMD_AVX2,        /**< 256 bits */
+    SIMD_AVX512       /**< 512 bits, needs AVX512F and AVX512BW */
+};
+
+/**
+ * get instruction set used by kernels, detected at first call
+ * @retval best level supported by this cpu
+ */
+SimdLevel simd_level(void);
+
+/**
+ * compare every value of a column vector against a constant
+ * @param type     INT8..INT64, FLOAT32, FLOAT64, DATE, TIME, DATETIME or CHARDICT
+ * @param data     column vector, num values of type
+ * @param num      number of values
+ * @param op       compare method
+ * @param constant constant of type
+ * @param mask     (num + 63) / 64 words, bit i is set if value i passes
+ * @retval true    success
+ * @retval false   type not supported
+ */
+bool simd_compare(TypeCode type, const void *data, int64_t num, SimdCompare op,
+                  const void *constant, uint64_t *mask);
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file    sorter.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  sort of fixed-length rows by normalized keys.
+ *
+ */
+
+#include "sorter.h"
+#include <algorithm>
+
+/** first 8 bytes of a key as a big-endian number, missing bytes are zero */
+static inline uint64_t key_prefix(const char *key, int64_t key_size) {
+    uint64_t prefix = 0;
+    for (int64_t ii = 0; ii < 8; ii++)
+        prefix = (prefix << 8) | (ii < key_size ? (uint8_t) key[ii] : 0);
+    return prefix;
+}
+
+void RowSorter::init(int64_t row_length, const std::vector<SortKey> &keys) {
+    rs_row_length = row_length;
+    rs_keys = keys;
+    rs_key_size = 0;
+    for (size_t ii = 0; ii < keys.size(); ii++)
+        rs_key_size += keys[ii].ops.size;
+}
+
+void RowSorter::normalize(char *key, const char *row) {
+    for (size_t ii = 0; ii < rs_keys.size(); ii++) {
+        const SortKey &col = rs_keys[ii];
+        col.ops.normalize(key, row + col.offset, col.ops.size);
+        key += col.ops.size;
+    }
+}
+
+void RowSorter::sort(const char *rows, int64_t num, char *out, char *out_keys) {
+    std::vector<char> keys(num * rs_key_size);
+    std::vector<uint64_t> prefixes(num);
+    std::vector<int64_t> ranks(num);
+    for (int64_t r = 0; r < num; r++) {
+        normalize(&keys[r * rs_key_size], rows + r * rs_row_length);
+        prefixes[r] = key_prefix(&keys[r * rs_key_size], rs_key_size);
+        ranks[r] = r;
+    }
+    if (rs_key_size <= 8)
+        radixSort(prefixes, ranks);
+    else {
+        // prefixes decide most comparisons, the rest of the key breaks ties
+        const char *rest = keys.data() + 8;
+        int64_t key_size = rs_key_size;
+        std::sort(ranks.begin(), ranks.end(), [&](int64_t l, int64_t r) {
+            if (prefixes[l] != prefixes[r])
+                return prefixes[l] < prefixes[r];
+            return memcmp(rest + l * key_size, rest + r * key_size, key_size - 8) < 0;
+        });
+    }
+    for (int64_t r = 0; r < num; r++)
+        memcpy(out + r * rs_row_length, rows + ranks[r] * rs_row_length, rs_row_length);
+    if (out_keys != NULL) {
+        for (int64_t r = 0; r < num; r++)
+            memcpy(out_keys + r * rs_key_size, &keys[ranks[r] * rs_key_size], rs_key_size);
+    }
+}
+
+void RowSorter::radixSort(std::vector<uint64_t> &prefixes, std::vector<int64_t> &ranks) {
+    int64_t num = ranks.size();
+    const int64_t buckets = 1L << SORT_RADIX_BITS;
+    std::vector<uint64_t> prefixes_tmp(num);
+    std::vector<int64_t> ranks_tmp(num);
+    // the key is in the high bytes of a prefix, its low bytes are zero
+    for (int64_t shift = 64 - 8 * rs_key_size; shift < 64; shift += SORT_RADIX_BITS) {
+        int64_t count[buckets + 1] = {0};
+        for (int64_t r = 0; r < num; r++)
+            count[((prefixes[r] >> shift) & (buckets - 1)) + 1]++;
+        // a byte that is the same in all keys does not reorder them
+        bool skip = false;
+        for (int64_t b = 1; b <= buckets && !skip; b++)
+            skip = count[b] == num;
+        if (skip)
+            continue;
+        for (int64_t b = 0; b < buckets; b++)
+            count[b + 1] += count[b];
+        for (int64_t r = 0; r < num; r++) {
+            int64_t pos = count[(prefixes[r] >> shift) & (buckets - 1)]++;
+            prefixes_tmp[pos] = prefixes[r];
+            ranks_tmp[pos] = ranks[r];
+        }
+        prefixes.swap(prefixes_tmp);
+        ranks.swap(ranks_tmp);
+    }
+}
+
+void RunMerger::init(const char *rows, const char *keys, int64_t row_length, int64_t key_size,
+                     const std::vector<int64_t> &begins, const std::vector<int64_t> &ends) {
+    rm_rows = rows;
+    rm_keys = keys;
+    rm_row_length = row_length;
+    rm_key_size = key_size;
+    rm_pos = begins;
+    rm_end = ends;
+    rm_heap.clear();
+    for (size_t run = 0; run < begins.size(); run++) {
+        if (begins[run] < ends[run])
+            rm_heap.push_back(run);
+    }
+    for (int64_t i = (int64_t) rm_heap.size() / 2 - 1; i >= 0; i--)
+        siftDown(i);
+}
+
+const char *RunMerger::next(void) {
+    if (rm_heap.empty())
+        return NULL;
+    int64_t run = rm_heap[0];
+    const char *row = rm_rows + rm_pos[run] * rm_row_length;
+    if (++rm_pos[run] == rm_end[run]) {
+        rm_heap[0] = rm_heap.back();
+        rm_heap.pop_back();
+    }
+    if (!rm_heap.empty())
+        siftDown(0);
+    return row;
+}
+
+void RunMerger::siftDown(int64_t i) {
+    int64_t num = rm_heap.size();
+    for (int64_t c = 2 * i + 1; c < num; i = c, c = 2 * i + 1) {
+        if (c + 1 < num && runLess(rm_heap[c + 1], rm_heap[c]))
+            c++;
+        if (!runLess(rm_heap[c], rm_heap[i]))
+            break;
+        std::swap(rm_heap[i], rm_heap[c]);
+    }
+}
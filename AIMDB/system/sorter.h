@@ -0,0 +1,124 @@
+/**
+ * @file    sorter.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  sort of fixed-length rows by normalized keys, the order columns of a row are
+ *  encoded once into a key compared by memcmp, keys are sorted with their row
+ *  rank and rows are moved once into their final place.
+ *
+ *  @basic usage:
+ *
+ *  (1) init with the row length and the order columns of a row.
+ *  (2) sort writes rows in order to another buffer, keys of at most 8 bytes are
+ *      sorted by LSD radix sort, longer keys by introsort on an 8 byte prefix
+ *      with memcmp of the rest when prefixes are equal.
+ *  (3) normalize gives the key of a single row, rows sorted by different sorters
+ *      of the same columns can be merged by comparing their keys.
+ *  (4) a sorter keeps no state between calls of sort, threads may share it.
+ *  (5) runs sorted one by one are merged by RunMerger, which returns rows in
+ *      order one at a time so a reader can start before the merge ends.
+ *
+ */
+
+#ifndef _SORTER_H
+#define _SORTER_H
+
+#include <stdint.h>
+#include <vector>
+#include "typeops.h"
+
+#define SORT_RADIX_BITS (8)     /**< bits of key sorted by one radix pass */
+
+/** definition of SortKey, an order column of a row. */
+struct SortKey {
+    int64_t offset;     /**< offset of the column in row     */
+    TypeOps ops;        /**< typed normalize of the column   */
+};
+
+/** definition of class RowSorter. */
+class RowSorter {
+  private:
+    int64_t rs_row_length = 0;          /**< length of a row                 */
+    std::vector<SortKey> rs_keys;       /**< order columns, most significant first */
+    int64_t rs_key_size = 0;            /**< size of a normalized key        */
+  public:
+    /**
+     * init.
+     * @param row_length length of a row
+     * @param keys       order columns, each must have a normalize function
+     */
+    void init(int64_t row_length, const std::vector<SortKey> &keys);
+    /**
+     * get size of a normalized key.
+     */
+    int64_t getKeySize(void) {
+        return rs_key_size;
+    }
+    /**
+     * write the normalized key of a row.
+     * @param key buffer of getKeySize() bytes
+     * @param row row to encode
+     */
+    void normalize(char *key, const char *row);
+    /**
+     * sort rows.
+     * @param rows input rows one after another
+     * @param num  number of rows
+     * @param out  buffer of num rows, receives rows in order
+     * @param out_keys buffer of num keys, receives their normalized keys in order, NULL if not needed
+     */
+    void sort(const char *rows, int64_t num, char *out, char *out_keys = NULL);
+  private:
+    /**
+     * sort ranks of rows whose keys fit in 8 bytes, stable.
+     * @param prefixes key of each row as a big-endian number
+     * @param ranks    receives row ranks in order
+     */
+    void radixSort(std::vector<uint64_t> &prefixes, std::vector<int64_t> &ranks);
+};  // class RowSorter
+
+/** definition of class RunMerger, k-way merge of sorted runs by their normalized keys. */
+class RunMerger {
+  private:
+    const char *rm_rows = NULL;         /**< rows of all runs                */
+    const char *rm_keys = NULL;         /**< normalized key of each row      */
+    int64_t rm_row_length = 0;          /**< length of a row                 */
+    int64_t rm_key_size = 0;            /**< size of a key                   */
+    std::vector<int64_t> rm_pos;        /**< rank of next row of each run    */
+    std::vector<int64_t> rm_end;        /**< rank after last row of each run */
+    std::vector<int64_t> rm_heap;       /**< runs with rows left, the one with the first row on top */
+  public:
+    /**
+     * init.
+     * @param rows       rows, each run in order
+     * @param keys       normalized key of each row
+     * @param row_length length of a row
+     * @param key_size   size of a key
+     * @param begins     rank of first row of each run
+     * @param ends       rank after last row of each run
+     */
+    void init(const char *rows, const char *keys, int64_t row_length, int64_t key_size,
+              const std::vector<int64_t> &begins, const std::vector<int64_t> &ends);
+    /**
+     * get next row in order, rows of equal keys come in order of their runs.
+     * @retval row, NULL if all runs are merged
+     */
+    const char *next(void);
+  private:
+    /**
+     * whether the next row of run a comes before the next row of run b.
+     */
+    bool runLess(int64_t a, int64_t b) {
+        int c = memcmp(rm_keys + rm_pos[a] * rm_key_size, rm_keys + rm_pos[b] * rm_key_size, rm_key_size);
+        return c < 0 || (c == 0 && a < b);
+    }
+    /**
+     * move a run down the heap to its place.
+     */
+    void siftDown(int64_t i);
+};  // class RunMerger
+
+#endif
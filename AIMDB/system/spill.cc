@@ -0,0 +1,150 @@
+/**
+ * @file    spill.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  temporary files of fixed-length binary rows.
+ *
+ */
+
+#include "spill.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <algorithm>
+
+int64_t spill_budget(void) {
+    const char *budget_env = getenv("AIMDB_MEMORY_BUDGET");
+    int64_t budget = budget_env != NULL ? atoll(budget_env) : SPILL_MEMORY_BUDGET;
+    return std::max(budget, (int64_t) SPILL_BLOCK_SIZE);
+}
+
+bool SpillFile::open(int64_t row_length) {
+    close();
+    const char *dir_env = getenv("AIMDB_SPILL_DIR");
+    std::string name = std::string(dir_env != NULL ? dir_env : "/tmp") + "/aimdb_spill_XXXXXX";
+    std::vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        printf("[SpillFile][ERROR][open]: can not create %s!\n", name.c_str());
+        return false;
+    }
+    // the file lives as long as it is open
+    unlink(path.data());
+    sf_file = fdopen(fd, "w+b");
+    if (sf_file == NULL) {
+        ::close(fd);
+        printf("[SpillFile][ERROR][open]: can not open %s!\n", path.data());
+        return false;
+    }
+    sf_row_length = row_length;
+    // a block holds whole rows, at least one
+    int64_t rows = std::max((int64_t) 1, SPILL_BLOCK_SIZE / row_length);
+    sf_block.resize(rows * row_length);
+    sf_fill = 0;
+    sf_pos = 0;
+    sf_row_num = 0;
+    return true;
+}
+
+bool SpillFile::append(const char *row) {
+    if (sf_fill + sf_row_length > (int64_t) sf_block.size()) {
+        if (fwrite(sf_block.data(), 1, sf_fill, sf_file) != (size_t) sf_fill) {
+            printf("[SpillFile][ERROR][append]: write failed!\n");
+            return false;
+        }
+        sf_fill = 0;
+    }
+    memcpy(&sf_block[sf_fill], row, sf_row_length);
+    sf_fill += sf_row_length;
+    sf_row_num++;
+    return true;
+}
+
+bool SpillFile::rewind(void) {
+    if (sf_fill > 0 && fwrite(sf_block.data(), 1, sf_fill, sf_file) != (size_t) sf_fill) {
+        printf("[SpillFile][ERROR][rewind]: write failed!\n");
+        return false;
+    }
+    if (fflush(sf_file) != 0) {
+        printf("[SpillFile][ERROR][rewind]: flush failed!\n");
+        return false;
+    }
+    ::rewind(sf_file);
+    sf_fill = 0;
+    sf_pos = 0;
+    return true;
+}
+
+const char *SpillFile::next(void) {
+    if (sf_pos >= sf_fill) {
+        sf_fill = fread(sf_block.data(), 1, sf_block.size(), sf_file);
+        sf_pos = 0;
+        if (sf_fill < sf_row_length)
+            return NULL;
+    }
+    const char *row = &sf_block[sf_pos];
+    sf_pos += sf_row_length;
+    return row;
+}
+
+void SpillFile::close(void) {
+    if (sf_file != NULL)
+        fclose(sf_file);
+    sf_file = NULL;
+    std::vector<char>().swap(sf_block);
+}
+
+bool SpillMerger::init(RowSorter *sorter, const std::vector<SpillFile *> &runs) {
+    sm_sorter = sorter;
+    sm_runs = runs;
+    sm_heads.assign(runs.size(), NULL);
+    sm_keys.resize(runs.size() * sorter->getKeySize());
+    sm_heap.clear();
+    sm_taken = false;
+    for (size_t run = 0; run < runs.size(); run++) {
+        if (!runs[run]->rewind())
+            return false;
+        if (advance(run))
+            sm_heap.push_back(run);
+    }
+    for (int64_t i = (int64_t) sm_heap.size() / 2 - 1; i >= 0; i--)
+        siftDown(i);
+    return true;
+}
+
+bool SpillMerger::advance(int64_t run) {
+    sm_heads[run] = sm_runs[run]->next();
+    if (sm_heads[run] == NULL)
+        return false;
+    sm_sorter->normalize(&sm_keys[run * sm_sorter->getKeySize()], sm_heads[run]);
+    return true;
+}
+
+const char *SpillMerger::next(void) {
+    // the run of the row returned last reads on only now, that row stayed in its block
+    if (sm_taken && !sm_heap.empty()) {
+        if (!advance(sm_heap[0])) {
+            sm_heap[0] = sm_heap.back();
+            sm_heap.pop_back();
+        }
+        if (!sm_heap.empty())
+            siftDown(0);
+    }
+    sm_taken = !sm_heap.empty();
+    return sm_taken ? sm_heads[sm_heap[0]] : NULL;
+}
+
+void SpillMerger::siftDown(int64_t i) {
+    int64_t num = sm_heap.size();
+    for (int64_t c = 2 * i + 1; c < num; i = c, c = 2 * i + 1) {
+        if (c + 1 < num && runLess(sm_heap[c + 1], sm_heap[c]))
+            c++;
+        if (!runLess(sm_heap[c], sm_heap[i]))
+            break;
+        std::swap(sm_heap[i], sm_heap[c]);
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @file    spill.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  temporary files of fixed-length binary rows, written by operators whose state
+ *  exceeds their memory budget and read back in order with large sequential I/O.
+ *
+ *  @basic usage:
+ *
+ *  (1) spill_budget gives the bytes of state an operator keeps in memory,
+ *      environment variable AIMDB_MEMORY_BUDGET overrides SPILL_MEMORY_BUDGET.
+ *  (2) open a SpillFile with the row length, append rows, rewind, then read
+ *      them back with next, rows go through a buffer of SPILL_BLOCK_SIZE bytes.
+ *  (3) files are created in AIMDB_SPILL_DIR, /tmp by default, and unlinked at
+ *      once, they are gone when closed or when the process ends.
+ *  (4) SpillMerger merges files of rows sorted by a RowSorter, the sort runs
+ *      of an external sort.
+ *  (5) hash partitioned state is spilled to SPILL_PARTITIONS files by
+ *      spill_partition, a file too large for memory is split again by the
+ *      next bits of the hash.
+ *
+ */
+
+#ifndef _SPILL_H
+#define _SPILL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "sorter.h"
+
+#define SPILL_MEMORY_BUDGET (1L << 30)  /**< default bytes of state an operator keeps in memory */
+#define SPILL_BLOCK_SIZE    (1L << 20)  /**< bytes of a spill file read or written at once      */
+#define SPILL_MERGE_FANIN   (64)        /**< sorted runs merged at once, more are merged in passes */
+#define SPILL_PARTITIONS    (16)        /**< hash partitions an operator spills rows into        */
+#define SPILL_MAX_DEPTH     (4)         /**< times a spilled partition is split again at most    */
+
+/**
+ * get the spill partition of a hash, partitions split again use further bits.
+ * @param hash  hash of the row
+ * @param depth times the partition of the row was split
+ * @retval partition in [0, SPILL_PARTITIONS)
+ */
+inline int64_t spill_partition(uint64_t hash, int64_t depth) {
+    return (hash >> (32 + 4 * depth)) % SPILL_PARTITIONS;
+}
+
+/**
+ * get bytes of state an operator keeps in memory before it spills.
+ * @retval budget, at least one block
+ */
+int64_t spill_budget(void);
+
+/** definition of class SpillFile, a temporary file of rows. */
+class SpillFile {
+  private:
+    FILE *sf_file = NULL;               /**< file, NULL if not open                   */
+    int64_t sf_row_length = 0;          /**< length of a row                          */
+    std::vector<char> sf_block;         /**< rows to write, or rows read              */
+    int64_t sf_fill = 0;                /**< bytes of rows in block                   */
+    int64_t sf_pos = 0;                 /**< bytes of block already read              */
+    int64_t sf_row_num = 0;             /**< rows appended                            */
+  public:
+    /**
+     * destruction, close the file.
+     */
+    ~SpillFile() {
+        close();
+    }
+    /**
+     * create the file.
+     * @param row_length length of a row
+     * @retval false for failure
+     * @retval true  for success
+     */
+    bool open(int64_t row_length);
+    /**
+     * append a row.
+     * @retval false for failure
+     * @retval true  for success
+     */
+    bool append(const char *row);
+    /**
+     * write rows still buffered and read from the first row on.
+     * @retval false for failure
+     * @retval true  for success
+     */
+    bool rewind(void);
+    /**
+     * read next row.
+     * @retval row, valid until next call, NULL after the last row
+     */
+    const char *next(void);
+    /**
+     * get number of rows appended.
+     */
+    int64_t getRowNum(void) {
+        return sf_row_num;
+    }
+    /**
+     * close and remove the file.
+     */
+    void close(void);
+};  // class SpillFile
+
+/** definition of class SpillMerger, merge of sorted runs spilled to files. */
+class SpillMerger {
+  private:
+    RowSorter *sm_sorter = NULL;        /**< sorter the runs were sorted by           */
+    std::vector<SpillFile *> sm_runs;   /**< runs                                     */
+    std::vector<const char *> sm_heads; /**< next row of each run                     */
+    std::vector<char> sm_keys;          /**< normalized key of next row of each run   */
+    std::vector<int64_t> sm_heap;       /**< runs with rows left, the one with the first row on top */
+    bool sm_taken = false;              /**< row of the run on top was returned, the run moves on at next call */
+  public:
+    /**
+     * init, rewind runs.
+     * @param sorter sorter of the rows
+     * @param runs   runs, each in order
+     * @retval false for failure
+     * @retval true  for success
+     */
+    bool init(RowSorter *sorter, const std::vector<SpillFile *> &runs);
+    /**
+     * get next row in order, rows of equal keys come in order of their runs.
+     * @retval row, valid until next call, NULL if all runs are merged
+     */
+    const char *next(void);
+  private:
+    /**
+     * whether the next row of run a comes before the next row of run b.
+     */
+    bool runLess(int64_t a, int64_t b) {
+        int64_t key_size = sm_sorter->getKeySize();
+        int c = memcmp(&sm_keys[a * key_size], &sm_keys[b * key_size], key_size);
+        return c < 0 || (c == 0 && a < b);
+    }
+    /**
+     * read next row of a run and its key.
+     * @retval false if the run is at its end
+     */
+    bool advance(int64_t run);
+    /**
+     * move a run down the heap to its place.
+     */
+    void siftDown(int64_t i);
+};  // class SpillMerger
+
+#endif
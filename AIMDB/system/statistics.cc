@@ -0,0 +1,287 @@
+/**
+ * @file    statistics.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  column statistics used by the planner: row count, invalid count, min/max,
+ *  number of distinct values, most common values and equi-depth histogram.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "statistics.h"
+
+/** partial statistics of one column, collected by one thread. */
+struct ColumnPartial {
+    char *min = NULL;                       /**< pointer to minimum value in table */
+    char *max = NULL;                       /**< pointer to maximum value in table */
+    std::vector<uint8_t> hll;               /**< HyperLogLog registers             */
+};
+
+/** partial statistics of a range of rows, collected by one thread. */
+struct TablePartial {
+    int64_t row_begin = 0;                  /**< first record rank of the range    */
+    int64_t row_end = 0;                    /**< end record rank of the range      */
+    int64_t invalid_count = 0;              /**< deleted records in the range      */
+    int64_t sample_cap = 0;                 /**< rows this thread may sample       */
+    int64_t seen = 0;                       /**< valid rows seen, for reservoir    */
+    std::vector<char *> sample;             /**< reservoir sample of valid rows    */
+    std::vector<ColumnPartial> cols;        /**< one per column                    */
+};
+
+/**
+ * hash a value for HyperLogLog, CHARN values are hashed up to their end
+ */
+static uint64_t hashValue(char *data, int64_t size, bool is_text)
+{
+    if (is_text)
+        size = strnlen(data, size);
+    uint64_t h = 14695981039346656037ULL;
+    for (int64_t ii = 0; ii < size; ii++) {
+        h ^= (uint8_t) data[ii];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * scan a range of rows, the work of one analyze thread
+ */
+static void analyzeRange(RowTable *table, TablePartial *part)
+{
+    RPattern &pattern = table->getRPattern();
+    MStorage &storage = table->getMStorage();
+    int64_t col_num = table->getColumns().size();
+    int64_t row_size = pattern.getRowSize();
+    std::vector<BasicType *> types(col_num);
+    std::vector<int64_t> offsets(col_num);
+    for (int64_t cc = 0; cc < col_num; cc++) {
+        types[cc] = pattern.getColumnType(cc);
+        offsets[cc] = pattern.getColumnOffset(cc);
+        part->cols[cc].hll.assign(1L << STATS_HLL_BITS, 0);
+    }
+    uint64_t random = 0x9E3779B97F4A7C15ULL ^ (uint64_t) part->row_begin;
+    for (int64_t rr = part->row_begin; rr < part->row_end; rr++) {
+        char *row = storage.getRow(rr);
+        if (row[row_size - 1] != 'Y') {
+            part->invalid_count++;
+            continue;
+        }
+        // reservoir sampling of rows
+        if ((int64_t) part->sample.size() < part->sample_cap)
+            part->sample.push_back(row);
+        else {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            uint64_t pos = random % (uint64_t) (part->seen + 1);
+            if ((int64_t) pos < part->sample_cap)
+                part->sample[pos] = row;
+        }
+        part->seen++;
+        for (int64_t cc = 0; cc < col_num; cc++) {
+            ColumnPartial &col = part->cols[cc];
+            char *value = row + offsets[cc];
+            if (col.min == NULL || types[cc]->cmpLT(value, col.min))
+                col.min = value;
+            if (col.max == NULL || types[cc]->cmpGT(value, col.max))
+                col.max = value;
+            uint64_t h = hashValue(value, types[cc]->getTypeSize(),
+                                   types[cc]->getTypeCode() == CHARN_TC);
+            uint64_t reg = h >> (64 - STATS_HLL_BITS);
+            uint64_t rest = h << STATS_HLL_BITS;
+            uint8_t rank = rest == 0 ? 64 - STATS_HLL_BITS + 1 : __builtin_clzll(rest) + 1;
+            if (rank > col.hll[reg])
+                col.hll[reg] = rank;
+        }
+    }
+}
+
+/**
+ * estimate distinct values from HyperLogLog registers
+ */
+static double hllEstimate(std::vector<uint8_t> &hll)
+{
+    double m = (double) hll.size();
+    double sum = 0;
+    int64_t zeros = 0;
+    for (size_t ii = 0; ii < hll.size(); ii++) {
+        sum += std::ldexp(1.0, -hll[ii]);
+        if (hll[ii] == 0)
+            zeros++;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0)
+        estimate = m * std::log(m / zeros);   // linear counting for small sets
+    return estimate;
+}
+
+bool analyzeTable(RowTable *table, std::vector<ColumnStats> &stats)
+{
+    if (table == NULL) {
+        printf("[analyzeTable][ERROR]: table is NULL!\n");
+        return false;
+    }
+    RPattern &pattern = table->getRPattern();
+    int64_t col_num = table->getColumns().size();
+    int64_t row_num = table->getRecordNum();
+
+    int64_t thread_num = std::thread::hardware_concurrency();
+    thread_num = std::min(thread_num, row_num / STATS_THREAD_ROWS);
+    if (thread_num < 1)
+        thread_num = 1;
+    std::vector<TablePartial> parts(thread_num);
+    for (int64_t tt = 0; tt < thread_num; tt++) {
+        parts[tt].row_begin = row_num * tt / thread_num;
+        parts[tt].row_end = row_num * (tt + 1) / thread_num;
+        parts[tt].sample_cap = (STATS_SAMPLE_SIZE + thread_num - 1) / thread_num;
+        parts[tt].cols.resize(col_num);
+    }
+    std::vector<std::thread> threads;
+    for (int64_t tt = 1; tt < thread_num; tt++)
+        threads.push_back(std::thread(analyzeRange, table, &parts[tt]));
+    analyzeRange(table, &parts[0]);
+    for (size_t tt = 0; tt < threads.size(); tt++)
+        threads[tt].join();
+
+    // merge partial results
+    int64_t invalid_count = 0;
+    int64_t valid_count = 0;
+    bool exact = true;      // every valid row is in the sample
+    std::vector<char *> sample;
+    for (int64_t tt = 0; tt < thread_num; tt++) {
+        invalid_count += parts[tt].invalid_count;
+        valid_count += parts[tt].seen;
+        if (parts[tt].seen > parts[tt].sample_cap)
+            exact = false;
+        sample.insert(sample.end(), parts[tt].sample.begin(), parts[tt].sample.end());
+    }
+
+    stats.clear();
+    stats.resize(col_num);
+    for (int64_t cc = 0; cc < col_num; cc++) {
+        ColumnStats &st = stats[cc];
+        BasicType *type = pattern.getColumnType(cc);
+        int64_t size = type->getTypeSize();
+        int64_t offset = pattern.getColumnOffset(cc);
+        st.type = type;
+        st.row_count = row_num;
+        st.invalid_count = invalid_count;
+        if (valid_count == 0)
+            continue;
+
+        std::vector<uint8_t> hll(1L << STATS_HLL_BITS, 0);
+        char *min = NULL;
+        char *max = NULL;
+        for (int64_t tt = 0; tt < thread_num; tt++) {
+            ColumnPartial &col = parts[tt].cols[cc];
+            if (col.min == NULL)
+                continue;
+            if (min == NULL || type->cmpLT(col.min, min))
+                min = col.min;
+            if (max == NULL || type->cmpGT(col.max, max))
+                max = col.max;
+            for (size_t ii = 0; ii < hll.size(); ii++)
+                hll[ii] = std::max(hll[ii], col.hll[ii]);
+        }
+        st.min.assign(min, size);
+        st.max.assign(max, size);
+
+        // sorted sample gives MCVs and histogram
+        std::vector<char *> values(sample.size());
+        for (size_t ii = 0; ii < sample.size(); ii++)
+            values[ii] = sample[ii] + offset;
+        std::sort(values.begin(), values.end(), [type](char *l, char *r) {
+            return type->cmpLT(l, r);
+        });
+        std::vector<std::pair<int64_t, char *> > runs;
+        for (size_t ii = 0; ii < values.size();) {
+            size_t jj = ii + 1;
+            while (jj < values.size() && type->cmpEQ(values[ii], values[jj]))
+                jj++;
+            runs.push_back(std::make_pair((int64_t) (jj - ii), values[ii]));
+            ii = jj;
+        }
+        double distinct = exact ? (double) runs.size() : hllEstimate(hll);
+        st.distinct = std::max((int64_t) 1, std::min(valid_count, (int64_t) std::llround(distinct)));
+
+        std::stable_sort(runs.begin(), runs.end(),
+                         [](const std::pair<int64_t, char *> &l, const std::pair<int64_t, char *> &r) {
+            return l.first > r.first;
+        });
+        for (size_t ii = 0; ii < runs.size() && ii < STATS_MCV_NUM; ii++) {
+            if (!exact && runs[ii].first < 2)  // a value seen once in the sample is not common
+                break;
+            st.mcv_values.push_back(std::string(runs[ii].second, size));
+            st.mcv_freqs.push_back((double) runs[ii].first / values.size());
+        }
+        for (int64_t bb = 0; bb <= STATS_HISTOGRAM_BUCKETS; bb++) {
+            size_t pos = (values.size() - 1) * bb / STATS_HISTOGRAM_BUCKETS;
+            st.histogram.push_back(std::string(values[pos], size));
+        }
+    }
+    return true;
+}
+
+double ColumnStats::eqFraction(char *value)
+{
+    if (row_count - invalid_count <= 0)
+        return 0;
+    if (type->cmpLT(value, (char *) min.data()) || type->cmpGT(value, (char *) max.data()))
+        return 0;
+    double mcv_total = 0;
+    for (size_t ii = 0; ii < mcv_values.size(); ii++) {
+        if (type->cmpEQ(value, (char *) mcv_values[ii].data()))
+            return mcv_freqs[ii];
+        mcv_total += mcv_freqs[ii];
+    }
+    int64_t others = distinct - (int64_t) mcv_values.size();
+    if (others <= 0)
+        return 0;
+    return std::max(0.0, 1 - mcv_total) / others;
+}
+
+double ColumnStats::ltFraction(char *value, bool or_equal)
+{
+    if (histogram.empty())
+        return 0;
+    int64_t below = 0;
+    for (size_t ii = 0; ii < histogram.size(); ii++) {
+        char *bound = (char *) histogram[ii].data();
+        if (type->cmpLT(bound, value) || (or_equal && type->cmpEQ(bound, value)))
+            below++;
+    }
+    int64_t buckets = histogram.size() - 1;
+    if (below == 0)
+        return 0;
+    if (below > buckets)
+        return 1;
+    // the bucket holding value is assumed half below it
+    return (below - 0.5) / buckets;
+}
+
+void ColumnStats::print(void)
+{
+    // dictionary codes are formatted as their texts
+    int64_t text_size = type->getTypeCode() == CHARDICT_TC ? ((TypeCharDict *) type)->getTextSize() : type->getTypeSize();
+    std::vector<char> buffer(text_size + 64, 0);
+    printf("rows %ld invalid %ld distinct %ld", row_count, invalid_count, distinct);
+    if (!min.empty()) {
+        type->formatTxt(buffer.data(), (char *) min.data());
+        printf(" min %s", buffer.data());
+        std::fill(buffer.begin(), buffer.end(), 0);
+        type->formatTxt(buffer.data(), (char *) max.data());
+        printf(" max %s", buffer.data());
+    }
+    printf(" mcv %zu histogram %zu\n", mcv_values.size(), histogram.size());
+}
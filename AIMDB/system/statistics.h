@@ -0,0 +1,76 @@
+/**
+ * @file    statistics.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  column statistics used by the planner: row count, invalid count, min/max,
+ *  number of distinct values, most common values and equi-depth histogram.
+ *
+ *  @basic usage:
+ *
+ *  (1) analyzeTable scans a RowTable once, the rows are split among threads,
+ *      each thread keeps its own counters, HyperLogLog sketch and row sample.
+ *  (2) the partial results are merged, MCVs and histogram come from the merged sample.
+ *  (3) values are kept in binary format of the column type, compare them with BasicType.
+ *  (4) statistics are not renewed on every change, the catalog analyzes a table again once
+ *      STATS_STALE_RATIO of its records were inserted, updated or deleted.
+ *
+ */
+
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+#include <string>
+#include <vector>
+#include "rowtable.h"
+
+#define STATS_HLL_BITS          (12)      /**< HyperLogLog uses 1<<STATS_HLL_BITS registers   */
+#define STATS_SAMPLE_SIZE       (1L<<15)  /**< rows sampled for MCVs and histogram            */
+#define STATS_MCV_NUM           (16)      /**< most common values kept per column             */
+#define STATS_HISTOGRAM_BUCKETS (32)      /**< buckets of equi-depth histogram                */
+#define STATS_THREAD_ROWS       (1L<<14)  /**< minimum rows scanned by one analyze thread     */
+#define STATS_STALE_RATIO       (0.1)     /**< fraction of records changed before statistics are renewed */
+
+/** definition of ColumnStats. */
+struct ColumnStats {
+    BasicType *type = NULL;                 /**< column data type, for comparing values     */
+    int64_t row_count = 0;                  /**< records in table when analyzed             */
+    int64_t invalid_count = 0;              /**< deleted records                            */
+    int64_t distinct = 0;                   /**< estimated number of distinct values        */
+    std::string min;                        /**< minimum value                              */
+    std::string max;                        /**< maximum value                              */
+    std::vector<std::string> mcv_values;    /**< most common values                         */
+    std::vector<double> mcv_freqs;          /**< fraction of valid records of each MCV      */
+    std::vector<std::string> histogram;     /**< bucket bounds, STATS_HISTOGRAM_BUCKETS + 1 */
+
+    /**
+     * estimate fraction of valid records equal to value
+     * @param value binary value of column type
+     * @retval fraction in [0, 1]
+     */
+    double eqFraction(char *value);
+    /**
+     * estimate fraction of valid records less than (or equal to) value
+     * @param value    binary value of column type
+     * @param or_equal count records equal to value too
+     * @retval fraction in [0, 1]
+     */
+    double ltFraction(char *value, bool or_equal);
+    /**
+     * print statistics
+     */
+    void print(void);
+};
+
+/**
+ * compute statistics of every column of a table in one parallel pass
+ * @param table table to analyze
+ * @param stats returns one ColumnStats per column, in column rank order
+ * @retval true  success
+ * @retval false failure
+ */
+bool analyzeTable(RowTable *table, std::vector<ColumnStats> &stats);
+
+#endif
@@ -0,0 +1,260 @@
+/**
+ * @file    typeops.cc
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  type-specialized compare, hash, normalization and text output of binary values, instantiated per concrete type.
+ *
+ */
+
+#include "typeops.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+/** finalize a hash, spread bits of small integers */
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+template <typename T>
+static int compare_typed(const char *l, const char *r, int64_t size) {
+    T a = load_value<T>(l), b = load_value<T>(r);
+    return (a > b) - (a < b);
+}
+
+static int compare_text(const char *l, const char *r, int64_t size) {
+    return strncmp(l, r, size);
+}
+
+template <typename T>
+static uint64_t hash_typed(const char *value, int64_t size) {
+    return hash_mix((uint64_t) load_value<T>(value));
+}
+
+/** floats hash their bits, -0.0 is turned into 0.0 first since they are equal */
+template <typename T, typename Bits>
+static uint64_t hash_float(const char *value, int64_t size) {
+    T v = load_value<T>(value) + (T) 0;
+    Bits bits;
+    memcpy(&bits, &v, sizeof(T));
+    return hash_mix((uint64_t) bits);
+}
+
+/** CHARN values are hashed up to their end, like strncmp compares them */
+static uint64_t hash_text(const char *value, int64_t size) {
+    size = strnlen(value, size);
+    uint64_t h = 14695981039346656037ULL;
+    for (int64_t ii = 0; ii < size; ii++) {
+        h ^= (uint8_t) value[ii];
+        h *= 1099511628211ULL;
+    }
+    return hash_mix(h);
+}
+
+/** store an unsigned value most significant byte first, memcmp then orders it as a number */
+template <typename U>
+static inline void store_big_endian(char *dst, U value) {
+    for (int ii = sizeof(U) - 1; ii >= 0; ii--) {
+        dst[ii] = (char) (value & 0xff);
+        value >>= 8;
+    }
+}
+
+/** signed integers flip their sign bit so negative values come first */
+template <typename T, typename U>
+static void normalize_int(char *dst, const char *value, int64_t size) {
+    store_big_endian<U>(dst, (U) load_value<T>(value) ^ ((U) 1 << (sizeof(U) * 8 - 1)));
+}
+
+/** positive floats flip their sign bit, negative floats flip all bits, -0.0 is 0.0 */
+template <typename T, typename U>
+static void normalize_float(char *dst, const char *value, int64_t size) {
+    T v = load_value<T>(value) + (T) 0;
+    U bits;
+    memcpy(&bits, &v, sizeof(T));
+    U sign = (U) 1 << (sizeof(U) * 8 - 1);
+    store_big_endian<U>(dst, (bits & sign) ? ~bits : bits ^ sign);
+}
+
+/** CHARN values end at their first zero, bytes after it are zeroed */
+static void normalize_text(char *dst, const char *value, int64_t size) {
+    strncpy(dst, value, size);
+}
+
+/** write digits of an unsigned value, at least width of them with leading zeros */
+static inline int64_t format_digits(char *dst, uint64_t value, int64_t width) {
+    char digits[20];
+    int64_t len = 0;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (len < width)
+        digits[len++] = '0';
+    for (int64_t ii = 0; ii < len; ii++)
+        dst[ii] = digits[len - 1 - ii];
+    return len;
+}
+
+/** integers as %d and %ld */
+template <typename T>
+static int64_t format_int(char *dst, const char *value, int64_t size) {
+    int64_t v = load_value<T>(value);
+    if (v >= 0)
+        return format_digits(dst, v, 1);
+    dst[0] = '-';
+    return 1 + format_digits(dst + 1, 0 - (uint64_t) v, 1);
+}
+
+/**
+ * floats as %f, value rounded to 6 decimals from its scaled form, printf decides
+ * values too large for that and values whose scaled form is too close to a tie
+ */
+template <typename T>
+static int64_t format_float(char *dst, const char *value, int64_t size) {
+    double v = load_value<T>(value);
+    double scaled = fabs(v) * 1e6;
+    if (!(scaled < 4503599627370496.0))     // 2^52, also NaN and infinity
+        return snprintf(dst, TYPE_TEXT_SIZE, "%f", v);
+    double whole = floor(scaled);
+    double frac = scaled - whole;
+    // the product is off by half an ulp at most, ties within that are left to printf
+    if (fabs(frac - 0.5) <= scaled * 1e-15 + 1e-300)
+        return snprintf(dst, TYPE_TEXT_SIZE, "%f", v);
+    uint64_t micros = (uint64_t) whole + (frac > 0.5);
+    int64_t len = 0;
+    if (signbit(v))
+        dst[len++] = '-';
+    len += format_digits(dst + len, micros / 1000000, 1);
+    dst[len++] = '.';
+    return len + format_digits(dst + len, micros % 1000000, 6);
+}
+
+/** CHARN values up to their end */
+static int64_t format_text(char *dst, const char *value, int64_t size) {
+    int64_t len = strnlen(value, size);
+    memcpy(dst, value, len);
+    return len;
+}
+
+/** local calendar date of a time_t as %Y-%m-%d */
+static inline int64_t format_day(char *dst, const struct tm &tt) {
+    int64_t len = format_digits(dst, tt.tm_year + 1900, 1);
+    dst[len++] = '-';
+    len += format_digits(dst + len, tt.tm_mon + 1, 2);
+    dst[len++] = '-';
+    return len + format_digits(dst + len, tt.tm_mday, 2);
+}
+
+/** local clock time of a time_t as %H:%M:%S */
+static inline int64_t format_clock(char *dst, const struct tm &tt) {
+    int64_t len = format_digits(dst, tt.tm_hour, 2);
+    dst[len++] = ':';
+    len += format_digits(dst + len, tt.tm_min, 2);
+    dst[len++] = ':';
+    return len + format_digits(dst + len, tt.tm_sec, 2);
+}
+
+static int64_t format_date(char *dst, const char *value, int64_t size) {
+    time_t t = load_value<time_t>(value);
+    struct tm tt;
+    localtime_r(&t, &tt);
+    return format_day(dst, tt);
+}
+
+static int64_t format_time(char *dst, const char *value, int64_t size) {
+    time_t t = load_value<time_t>(value);
+    struct tm tt;
+    localtime_r(&t, &tt);
+    return format_clock(dst, tt);
+}
+
+static int64_t format_datetime(char *dst, const char *value, int64_t size) {
+    time_t t = load_value<time_t>(value);
+    struct tm tt;
+    localtime_r(&t, &tt);
+    int64_t len = format_day(dst, tt);
+    dst[len++] = ' ';
+    return len + format_clock(dst + len, tt);
+}
+
+TypeOps type_ops(BasicType *type) {
+    TypeOps ops;
+    ops.size = type->getTypeSize();
+    switch (type->getTypeCode()) {
+        case INT8_TC:
+            ops.compare = compare_typed<int8_t>;
+            ops.hash = hash_typed<int8_t>;
+            ops.normalize = normalize_int<int8_t, uint8_t>;
+            ops.format = format_int<int8_t>;
+            break;
+        case INT16_TC:
+        case CHARDICT_TC:   // order-preserving int16 codes
+            ops.compare = compare_typed<int16_t>;
+            ops.hash = hash_typed<int16_t>;
+            ops.normalize = normalize_int<int16_t, uint16_t>;
+            if (type->getTypeCode() == INT16_TC)
+                ops.format = format_int<int16_t>;
+            break;
+        case INT32_TC:
+            ops.compare = compare_typed<int32_t>;
+            ops.hash = hash_typed<int32_t>;
+            ops.normalize = normalize_int<int32_t, uint32_t>;
+            ops.format = format_int<int32_t>;
+            break;
+        case INT64_TC:
+        case DATE_TC:       // stored as time_t
+        case TIME_TC:
+        case DATETIME_TC:
+            ops.compare = compare_typed<int64_t>;
+            ops.hash = hash_typed<int64_t>;
+            ops.normalize = normalize_int<int64_t, uint64_t>;
+            ops.format = format_int<int64_t>;
+            break;
+        case FLOAT32_TC:
+            ops.compare = compare_typed<float>;
+            ops.hash = hash_float<float, uint32_t>;
+            ops.normalize = normalize_float<float, uint32_t>;
+            ops.format = format_float<float>;
+            break;
+        case FLOAT64_TC:
+            ops.compare = compare_typed<double>;
+            ops.hash = hash_float<double, uint64_t>;
+            ops.normalize = normalize_float<double, uint64_t>;
+            ops.format = format_float<double>;
+            break;
+        case CHARN_TC:
+            ops.compare = compare_text;
+            ops.hash = hash_text;
+            ops.normalize = normalize_text;
+            ops.format = format_text;
+            break;
+        default:
+            break;
+    }
+    // time values compare as int64, their text is a local calendar time
+    if (type->getTypeCode() == DATE_TC)
+        ops.format = format_date;
+    else if (type->getTypeCode() == TIME_TC)
+        ops.format = format_time;
+    else if (type->getTypeCode() == DATETIME_TC)
+        ops.format = format_datetime;
+    return ops;
+}
+
+bool typed_comparable(BasicType *type_a, BasicType *type_b) {
+    if (type_a == type_b)
+        return true;
+    if (type_a->getTypeCode() != type_b->getTypeCode() || type_a->getTypeSize() != type_b->getTypeSize())
+        return false;
+    // codes of two dictionaries stand for different texts
+    return type_a->getTypeCode() != CHARDICT_TC;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file    typeops.h
+ * @author  harvardchen97@gmail.com
+ * @version 0.1
+ *
+ * @section DESCRIPTION
+ *
+ *  type-specialized compare, hash, normalization and text output of binary values, instantiated per concrete type.
+ *
+ *  @basic usage:
+ *
+ *  (1) call type_ops once at plan time with the BasicType of a column.
+ *  (2) call the returned functions in inner loops instead of virtual BasicType methods,
+ *      there is no virtual call and no text formatting per value.
+ *  (3) normalize writes a value as size bytes whose memcmp order is the order of compare,
+ *      keys of several columns are compared by memcmp of their normalized values one after another.
+ *  (4) hashes of equal values are equal only for columns of the same type code and size,
+ *      check typed_comparable before mixing two columns.
+ *  (5) format writes a value as formatTxt does, with no printf and no terminating zero,
+ *      dst must hold TYPE_TEXT_SIZE bytes, or size bytes for CHARN.
+ *
+ */
+
+#ifndef _TYPEOPS_H
+#define _TYPEOPS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "datatype.h"
+
+#define TYPE_TEXT_SIZE (320)    /**< longest text format writes for a value other than CHARN, a double by %f */
+
+/** three-way compare of two values, returns <0, 0 or >0 */
+typedef int (*CompareFunc)(const char *l, const char *r, int64_t size);
+/** hash of a value */
+typedef uint64_t (*HashFunc)(const char *value, int64_t size);
+/** write size bytes of a value that compare by memcmp as the value compares */
+typedef void (*NormalizeFunc)(char *dst, const char *value, int64_t size);
+/** write a value as text, returns its length */
+typedef int64_t (*FormatFunc)(char *dst, const char *value, int64_t size);
+
+/** definition of TypeOps, operations of one column type chosen by TypeCode. */
+struct TypeOps {
+    int64_t size = 0;               /**< size of a value                */
+    CompareFunc compare = NULL;     /**< three-way compare              */
+    HashFunc hash = NULL;           /**< hash, equal values hash equal  */
+    NormalizeFunc normalize = NULL; /**< memcmp-comparable form of size bytes */
+    FormatFunc format = NULL;       /**< text as formatTxt writes it    */
+};
+
+/**
+ * get operations of a type
+ * @param type column type
+ * @retval operations, compare, hash and normalize are NULL if the type is not supported,
+ *         format is NULL too for CHARDICT, whose texts are kept by the type
+ */
+TypeOps type_ops(BasicType *type);
+
+/**
+ * whether values of two columns can be compared and hashed with typed operations,
+ * that is same type code and size, and the same dictionary for CHARDICT columns
+ * @param type_a type of first column
+ * @param type_b type of second column
+ * @retval true  use type_ops of either
+ * @retval false compare them as text
+ */
+bool typed_comparable(BasicType *type_a, BasicType *type_b);
+
+/**
+ * combine hash of one more key column into a hash
+ * @param seed hash so far
+ * @param hash hash of next column
+ * @retval combined hash
+ */
+inline uint64_t hash_combine(uint64_t seed, uint64_t hash) {
+    return seed ^ (hash + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * read a value of type T at any alignment
+ * @param p pointer to value
+ * @retval value
+ */
+template <typename T>
+inline T load_value(const char *p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+#endif